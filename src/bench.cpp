@@ -0,0 +1,945 @@
+#include "bench.hpp"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include "merkle.hpp"
+#include "duptree.hpp"
+#include "duptree_child.hpp"
+#include "duptree_plus.hpp"
+#include "sparse.hpp"
+#include "fattree.hpp"
+#include "rattree.hpp"
+#include "proof_cache.hpp"
+#include "update_log.hpp"
+#include "snapshot.hpp"
+#include "replay.hpp"
+#include "trace_file.hpp"
+#include "workload.hpp"
+#include "profiler.hpp"
+
+using namespace std;
+
+namespace {
+    vector<string> split(const string &s, char sep) {
+        vector<string> parts;
+        size_t begin = 0;
+        for (size_t end; (end = s.find(sep, begin)) != string::npos; begin = end + 1) {
+            parts.push_back(s.substr(begin, end - begin));
+        }
+        parts.push_back(s.substr(begin));
+        return parts;
+    }
+
+    string trim(const string &s) {
+        size_t b = s.find_first_not_of(" \t\r\n"), e = s.find_last_not_of(" \t\r\n");
+        return b == string::npos ? "" : s.substr(b, e - b + 1);
+    }
+
+    bool to_bool(const string &key, const string &v) {
+        if (v == "1" || v == "true" || v == "yes" || v == "on")
+            return true;
+        if (v == "0" || v == "false" || v == "no" || v == "off")
+            return false;
+        throw invalid_argument("invalid value for " + key + ": " + v);
+    }
+
+    Int to_int(const string &key, const string &v) {
+        size_t n = 0;
+        Int x;
+        try {
+            x = stoll(v, &n);
+        } catch (const exception &) {
+            n = 0;
+        }
+        if (n == 0 || n != v.length())
+            throw invalid_argument("invalid value for " + key + ": " + v);
+        return x;
+    }
+
+    double to_double(const string &key, const string &v) {
+        size_t n = 0;
+        double x;
+        try {
+            x = stod(v, &n);
+        } catch (const exception &) {
+            n = 0;
+        }
+        if (n == 0 || n != v.length())
+            throw invalid_argument("invalid value for " + key + ": " + v);
+        return x;
+    }
+
+    string json_string(const string &s) {
+        string out = "\"";
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                out.push_back('\\');
+                out.push_back(c);
+            } else if ((unsigned char)c < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out.append(buf);
+            } else {
+                out.push_back(c);
+            }
+        }
+        return out + "\"";
+    }
+
+    // binary_proofs: the verifier encoding, checked without the tree
+    string proof_of(const BenchConfig &config, MemChecker *checker, const string &key) {
+        return config.binary_proofs ? checker->gen_proof_binary(key) : checker->gen_proof(key);
+    }
+
+    bool check_proof(const BenchConfig &config, MemChecker *checker, const string &root,
+                     const string &key, const string &value, const string &proof) {
+        if (config.binary_proofs)
+            return verifier::verify(root, key, value, proof);
+        return checker->verify_proof(key, value, proof);
+    }
+
+    Int boundary_of(const BenchConfig &c) {
+        return c.boundary > 0 ? c.boundary : c.height;
+    }
+
+    using Clock = chrono::steady_clock;
+
+    Int nanos_since(Clock::time_point start) {
+        return chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+    }
+
+    // Wall time of f in ns; with profiling on, time not spent in hashing,
+    // codecs or IO is charged to the walk phase.
+    template <class F>
+    Int timed(F &&f) {
+        auto start = Clock::now();
+        {
+            prof::Scope walk(prof::WALK);
+            f();
+        }
+        return nanos_since(start);
+    }
+
+    string key_of(const CheckerEntry &entry, Int pos) {
+        return Workload::key_of(pos, entry.hex_keys);
+    }
+
+    // testDuptree: a small correctness check, then samples proofs and samples updates
+    // at uniformly random positions.
+    bool run_random(const BenchConfig &config, const CheckerEntry &entry, MemChecker *checker, IO *io, BenchReport &report) {
+        Int max_value = 1LL << (config.height < 62 ? config.height : 62);
+        vector<Int> sample0(10), sample1(config.samples), sample2(config.samples);
+        random_sample(sample0, 10, max_value);
+        random_sample(sample1, config.samples, max_value);
+        random_sample(sample2, config.samples, max_value);
+        // a digest per key: a binary MERKLE proof carries leaf siblings as 32
+        // bytes, and rat_tree stores leaves under the hash of their value, so
+        // keys written with one value would share a leaf and lose their proofs
+        string rs = random_string();
+        auto value_of = [&](const string &key) { return calculateSHA256Hash(rs + key); };
+
+        bool flag = true;
+        for (Int i : sample0) {
+            string si(key_of(entry, i));
+            checker->update(si, value_of(si));
+            checker->commit();
+            string proof = proof_of(config, checker, si);
+            flag = flag && check_proof(config, checker, checker->get_digest(), si, value_of(si), proof);
+        }
+        if (config.binary_proofs) {
+            // an absence claim carries no path to the root and must not verify
+            string forged = verifier::encode_proof(checker->proof_family(), "?");
+            string k0 = key_of(entry, sample0[0]);
+            flag = flag && !verifier::verify(checker->get_digest(), k0, value_of(k0), forged);
+        }
+        BenchRow small{entry.name, "random", "small_test", "", (Int)sample0.size()};
+        small.result = flag ? "passed" : "failed";
+        report.add(small);
+
+        OpLatency latency;
+        string temp;
+        Int ns = 0;
+        for (Int i : sample1) {
+            string key(key_of(entry, i));
+            Int t = timed([&] { temp = proof_of(config, checker, key); });
+            latency.gen_proof.record(t);
+            ns += t;
+        }
+        BenchRow read{entry.name, "random", "read", "", config.samples, ns / 1000};
+        read.latency = &latency;
+        report.add(read);
+        temp = calculateSHA256Hash(temp);
+
+        latency.reset();
+        BenchRow write{entry.name, "random", "write", "", config.samples};
+        ns = 0;
+        auto commit = [&]() {
+            pair<Int, Int> c;
+            Int t = timed([&] {
+                c = checker->commit();
+                io->flush();
+            });
+            latency.commit.record(t);
+            ns += t;
+            write.io_reads += c.first;
+            write.io_writes += c.second;
+        };
+        vector<pair<string, string>> batch;
+        auto update_batch = [&]() {
+            if (batch.empty())
+                return;
+            Int t = timed([&] { checker->update_batch(batch); });
+            for (size_t j = 0; j < batch.size(); ++j) {
+                latency.update.record(t / (Int)batch.size());
+            }
+            ns += t;
+            batch.clear();
+        };
+        for (Int i = 0; i < config.samples; ++i) {
+            string key(key_of(entry, sample2[i])), value(value_of(key));
+            if (config.write_batch > 1) {
+                batch.emplace_back(key, value);
+                if ((Int)batch.size() >= config.write_batch)
+                    update_batch();
+            } else {
+                Int t = timed([&] { checker->update(key, value); });
+                latency.update.record(t);
+                ns += t;
+            }
+            if (config.flush_every > 0 && (i + 1) % config.flush_every == 0) {
+                update_batch();
+                commit();
+            }
+        }
+        update_batch();
+        commit();
+        write.micros = ns / 1000;
+        write.latency = &latency;
+        report.add(write);
+
+        if (config.verify) {
+            latency.reset();
+            Int failed = 0;
+            ns = 0;
+            string root = checker->get_digest();
+            if (config.binary_proofs && config.verify_batch > 1) {
+                // latency is per proof, the batch time spread evenly
+                vector<string> keys, values, proofs;
+                auto check_batch = [&] {
+                    vector<uint8_t> ok;
+                    Int t = timed([&] { ok = verifier::verify_batch(root, keys, values, proofs, config.update_threads); });
+                    for (uint8_t r : ok) {
+                        latency.verify_proof.record(t / (Int)ok.size());
+                        failed += r ? 0 : 1;
+                    }
+                    ns += t;
+                    keys.clear();
+                    values.clear();
+                    proofs.clear();
+                };
+                for (Int i : sample2) {
+                    keys.push_back(key_of(entry, i));
+                    values.push_back(value_of(keys.back()));
+                    proofs.push_back(proof_of(config, checker, keys.back()));
+                    if ((Int)keys.size() == config.verify_batch)
+                        check_batch();
+                }
+                if (!keys.empty())
+                    check_batch();
+            } else {
+                for (Int i : sample2) {
+                    string key(key_of(entry, i));
+                    string proof = proof_of(config, checker, key);
+                    bool ok = false;
+                    string value(value_of(key));
+                    Int t = timed([&] { ok = check_proof(config, checker, root, key, value, proof); });
+                    latency.verify_proof.record(t);
+                    ns += t;
+                    failed += ok ? 0 : 1;
+                }
+            }
+            BenchRow verify{entry.name, "random", "verify", "", config.samples, ns / 1000};
+            verify.result = failed == 0 ? "passed" : "failed " + to_string(failed);
+            verify.latency = &latency;
+            report.add(verify);
+            flag = flag && failed == 0;
+        }
+        return flag;
+    }
+
+    // Runs blocks of ops through a checker, committing at every block boundary,
+    // and reports every config.stage blocks, per source (finish) and per checker (done).
+    class BlockDriver {
+        const BenchConfig &config;
+        MemChecker *checker;
+        BenchReport &report;
+        string workload, temp;
+        BenchRow all, total, stage;
+        OpLatency all_latency, total_latency, stage_latency;
+        Int stage_ns = 0, nb = 0, failed = 0;
+        // with verify, values committed so far and values written in the open block
+        unordered_map<string, string> committed, pending;
+
+        void add_stage() {
+            stage.micros = stage_ns / 1000;
+            total.ops += stage.ops;
+            total.micros += stage.micros;
+            total.io_reads += stage.io_reads;
+            total.io_writes += stage.io_writes;
+            total_latency.merge(stage_latency);
+            stage = BenchRow{all.checker, workload, "stage"};
+            stage_latency.reset();
+            stage_ns = 0;
+        }
+
+    public:
+        BlockDriver(const BenchConfig &config, const CheckerEntry &entry, MemChecker *checker, BenchReport &report, string workload)
+                : config(config), checker(checker), report(report), workload(workload),
+                  all{entry.name, workload, "total", "all"}, total{entry.name, workload, "trace"}, stage{entry.name, workload, "stage"} {}
+
+        void op(char type, const string &key, const string &value) {
+            if (type == 'r') {
+                Int t = timed([&] { temp = proof_of(config, checker, key); });
+                stage_latency.gen_proof.record(t);
+                stage_ns += t;
+                if (config.verify && pending.find(key) == pending.end()) {
+                    auto it = committed.find(key);
+                    if (it != committed.end()) {
+                        bool ok = false;
+                        string root = checker->get_digest();
+                        t = timed([&] { ok = check_proof(config, checker, root, key, it->second, temp); });
+                        stage_latency.verify_proof.record(t);
+                        stage_ns += t;
+                        failed += ok ? 0 : 1;
+                    }
+                }
+            } else {
+                Int t = timed([&] { checker->update(key, value); });
+                stage_latency.update.record(t);
+                stage_ns += t;
+                if (config.verify) {
+                    pending[key] = value;
+                }
+            }
+            ++stage.ops;
+        }
+
+        void end_block() {
+            pair<Int, Int> c;
+            Int t = timed([&] { c = checker->commit(); });
+            stage_latency.commit.record(t);
+            stage_ns += t;
+            stage.io_reads += c.first;
+            stage.io_writes += c.second;
+            for (auto &kv : pending) {
+                committed[kv.first] = std::move(kv.second);
+            }
+            pending.clear();
+
+            nb++;
+            if (nb % config.stage == 0) {
+                BenchRow row = stage;
+                row.micros = stage_ns / 1000;
+                row.stage = to_string(nb);
+                row.latency = &stage_latency;
+                report.add(row);
+                add_stage();
+            }
+        }
+
+        void block(const TraceBlock &block) {
+            for (const auto &o : block.ops) {
+                op(o.type, o.key, o.value);
+            }
+            if (block.committed) {
+                end_block();
+            }
+        }
+
+        // Closes one source (a trace file or a generated run).
+        void finish(const string &label) {
+            add_stage();
+            total.stage = label;
+            total.latency = &total_latency;
+            report.add(total);
+            all.ops += total.ops;
+            all.micros += total.micros;
+            all.io_reads += total.io_reads;
+            all.io_writes += total.io_writes;
+            all_latency.merge(total_latency);
+            total = BenchRow{all.checker, workload, "trace"};
+            total_latency.reset();
+            nb = 0;
+            temp = calculateSHA256Hash(temp);
+        }
+
+        void done() {
+            if (config.verify) {
+                all.result = failed == 0 ? "passed" : "failed " + to_string(failed);
+            }
+            all.latency = &all_latency;
+            report.add(all);
+        }
+    };
+
+    // testSparsetree: replays the eth traces.
+    void run_eth(const BenchConfig &config, const CheckerEntry &entry, MemChecker *checker, BenchReport &report) {
+        BlockDriver driver(config, entry, checker, report, "eth");
+        for (const auto &path : config.traces) {
+            // prefer the pre-compiled trace (./duptree compile ethXX.txt ethXX.bin)
+            string bin_path = path;
+            if (bin_path.size() > 4 && bin_path.compare(bin_path.size() - 4, 4, ".txt") == 0) {
+                bin_path.replace(bin_path.size() - 4, 4, ".bin");
+            }
+            TraceFile bin(bin_path);
+            bool compiled = false;
+            try {
+                compiled = bin.open();
+            } catch (const invalid_argument &e) {
+                cerr << e.what() << ", replaying " << path << " instead" << endl;
+            }
+            if (compiled) {
+                TraceFile::Op op;
+                string key, value;
+                Int last = config.last_block < 0 || config.last_block > bin.num_blocks() ? bin.num_blocks() : config.last_block;
+                for (Int i = config.first_block < 0 ? 0 : config.first_block; i < last; ++i) {
+                    auto block = bin.block(i);
+                    string suffix = "@" + to_string(block.number);
+                    while (block.ops.next(op)) {
+                        op.key_hex(key);
+                        if (op.type == 'w') {
+                            value.assign(key);
+                            value.append(op.value, op.value_len);
+                            value.append(suffix);
+                        }
+                        driver.op(op.type, key, value);
+                    }
+                    if (block.committed) {
+                        driver.end_block();
+                    }
+                }
+            } else {
+                TraceReplay replay(path, config.threads);
+                if (!replay.open()) {
+                    cerr << "open trace error: " << path << endl;
+                    continue;
+                }
+                TraceBlock block;
+                while (replay.next(block)) {
+                    if (block.number < config.first_block)
+                        continue;
+                    if (config.last_block >= 0 && block.number >= config.last_block)
+                        break;
+                    driver.block(block);
+                }
+            }
+            driver.finish(path);
+        }
+        driver.done();
+    }
+
+    // Generated blocks from a Workload (uniform, zipf, sequential or hotset keys).
+    void run_synthetic(const BenchConfig &config, const CheckerEntry &entry, MemChecker *checker, BenchReport &report) {
+        WorkloadConfig wc = config.synthetic;
+        wc.distribution = config.workload;
+        wc.key_space = config.keys > 0 ? config.keys : 1LL << (config.height < 62 ? config.height : 62);
+        Workload workload(wc, entry.hex_keys);
+        BlockDriver driver(config, entry, checker, report, config.workload);
+        TraceBlock block;
+        while (workload.next(block)) {
+            driver.block(block);
+        }
+        driver.finish(to_string(wc.blocks) + "x" + to_string(wc.ops_per_block));
+        driver.done();
+    }
+
+    string snapshot_result(const snapshot::Stats &st) {
+        ostringstream out;
+        out << "chunks " << st.chunks << " raw_bytes " << st.raw_bytes << " packed_bytes " << st.packed_bytes;
+        return out.str();
+    }
+}
+
+void bench_set(BenchConfig &config, const string &key, const string &value) {
+    if (key == "checker" || key == "checkers") {
+        config.checkers = split(value, ',');
+    } else if (key == "io") {
+        config.io = value;
+    } else if (key == "height") {
+        config.height = to_int(key, value);
+    } else if (key == "boundary") {
+        config.boundary = to_int(key, value);
+    } else if (key == "base_height") {
+        config.base_height = to_int(key, value);
+    } else if (key == "base_boundary") {
+        config.base_boundary = to_int(key, value);
+    } else if (key == "lazy") {
+        config.lazy = to_int(key, value);
+    } else if (key == "adapt") {
+        config.adapt = to_int(key, value);
+    } else if (key == "batch_size") {
+        config.batch_size = to_int(key, value);
+    } else if (key == "sync") {
+        config.sync = to_bool(key, value);
+    } else if (key == "create_db") {
+        config.create_db = to_bool(key, value);
+    } else if (key == "delete_db") {
+        config.delete_db = to_bool(key, value);
+    } else if (key == "workload") {
+        config.workload = value;
+    } else if (key == "trace" || key == "traces") {
+        config.traces = split(value, ',');
+    } else if (key == "blocks") {
+        auto range = split(value, ':');
+        if (range.size() != 2)
+            throw invalid_argument("invalid value for blocks: " + value);
+        config.first_block = range[0].empty() ? 0 : to_int(key, range[0]);
+        config.last_block = range[1].empty() ? -1 : to_int(key, range[1]);
+    } else if (key == "samples") {
+        config.samples = to_int(key, value);
+    } else if (key == "binary_proofs") {
+        config.binary_proofs = to_bool(key, value);
+    } else if (key == "verify_batch") {
+        config.verify_batch = to_int(key, value);
+    } else if (key == "proof_cache") {
+        config.proof_cache = to_int(key, value);
+    } else if (key == "reopen") {
+        config.reopen = to_bool(key, value);
+    } else if (key == "wal") {
+        config.wal = to_int(key, value);
+    } else if (key == "checkpoint") {
+        config.checkpoint = to_int(key, value);
+    } else if (key == "export") {
+        config.export_path = value;
+    } else if (key == "import") {
+        config.import_path = value;
+    } else if (key == "import_root" || key == "import_roots") {
+        config.import_roots = split(value, ',');
+    } else if (key == "retain") {
+        config.retain = to_int(key, value);
+    } else if (key == "gc_rate") {
+        config.gc_rate = to_int(key, value);
+    } else if (key == "write_batch") {
+        config.write_batch = to_int(key, value);
+    } else if (key == "update_threads") {
+        config.update_threads = (int)to_int(key, value);
+    } else if (key == "flush_every") {
+        config.flush_every = to_int(key, value);
+    } else if (key == "stage") {
+        config.stage = to_int(key, value);
+    } else if (key == "keys") {
+        config.keys = to_int(key, value);
+    } else if (key == "zipf_s") {
+        config.synthetic.zipf_s = to_double(key, value);
+    } else if (key == "read_ratio") {
+        config.synthetic.read_ratio = to_double(key, value);
+    } else if (key == "hot_size") {
+        config.synthetic.hot_size = to_int(key, value);
+    } else if (key == "hot_fraction") {
+        config.synthetic.hot_fraction = to_double(key, value);
+    } else if (key == "hot_shift") {
+        config.synthetic.hot_shift = to_int(key, value);
+    } else if (key == "scramble") {
+        config.synthetic.scramble = to_bool(key, value);
+    } else if (key == "ops_per_block") {
+        config.synthetic.ops_per_block = to_int(key, value);
+    } else if (key == "num_blocks") {
+        config.synthetic.blocks = to_int(key, value);
+    } else if (key == "seed") {
+        config.synthetic.seed = (uint64_t)to_int(key, value);
+    } else if (key == "profile") {
+        config.profile = to_bool(key, value);
+    } else if (key == "verify") {
+        config.verify = to_bool(key, value);
+    } else if (key == "threads") {
+        config.threads = (int)to_int(key, value);
+    } else if (key == "format") {
+        config.format = value;
+    } else if (key == "output" || key == "out") {
+        config.output = value;
+    } else if (key == "config") {
+        bench_load(config, value);
+    } else {
+        throw invalid_argument("unknown option: " + key);
+    }
+}
+
+void bench_load(BenchConfig &config, const string &path) {
+    ifstream in(path);
+    if (!in)
+        throw invalid_argument("cannot open config: " + path);
+    string line;
+    while (getline(in, line)) {
+        line = trim(line);
+        if (line.empty() || line[0] == '#')
+            continue;
+        auto eq = line.find('=');
+        if (eq == string::npos)
+            throw invalid_argument("invalid config line: " + line);
+        bench_set(config, trim(line.substr(0, eq)), trim(line.substr(eq + 1)));
+    }
+}
+
+void bench_parse(BenchConfig &config, int argc, char **argv, int first) {
+    for (int i = first; i < argc; ++i) {
+        string arg(argv[i]);
+        while (!arg.empty() && arg[0] == '-')
+            arg.erase(0, 1);
+        auto eq = arg.find('=');
+        if (eq == string::npos)
+            throw invalid_argument("expected key=value: " + string(argv[i]));
+        bench_set(config, arg.substr(0, eq), arg.substr(eq + 1));
+    }
+    if (config.stage <= 0)
+        throw invalid_argument("stage must be positive");
+    if (config.format != "text" && config.format != "csv" && config.format != "json")
+        throw invalid_argument("unknown format: " + config.format);
+}
+
+string bench_usage() {
+    string s = "usage: duptree [key=value ...]\n"
+               "       duptree compile ethXX.txt ethXX.bin\n"
+               "       duptree list\n"
+               "  checker=a,b       checkers to run (see list)\n"
+               "  io=leveldb        leveldb | memory\n"
+               "  height=40 boundary=0 base_height=4 base_boundary=4 lazy=-1 adapt=0 retain=0 gc_rate=0\n"
+               "  batch_size=10000 sync=0 create_db=1 delete_db=1 reopen=0 wal=0 checkpoint=100\n"
+               "  export=path import=path import_root=d1,...   snapshot files path.<checker>, one root per checker\n"
+               "  workload=eth      eth | random | uniform | zipf | sequential | hotset\n"
+               "  traces=eth00.txt,... blocks=first:last threads=0 stage=100000\n"
+               "  samples=1000000 flush_every=10000 write_batch=0 update_threads=0\n"
+               "  verify=0 binary_proofs=0 verify_batch=0 proof_cache=0 profile=0\n"
+               "  keys=2^height num_blocks=10000 ops_per_block=100 read_ratio=0.5 seed=1\n"
+               "  zipf_s=0.99 hot_size=1000 hot_fraction=0.9 hot_shift=100 scramble=1\n"
+               "  format=text       text | csv | json\n"
+               "  output=path       default stdout\n"
+               "  config=path       file of key=value lines, '#' comments\n";
+    return s;
+}
+
+const vector<CheckerEntry> &checker_registry() {
+    static const vector<CheckerEntry> registry = {
+            {"merkle_simple", false, [](const BenchConfig &c) { return new MerkleSimple(c.height); }},
+            {"merkle_child", false, [](const BenchConfig &c) { return new MerkleChild(c.height); }},
+            {"duptree_simple", false, [](const BenchConfig &c) {
+                return new DupTreeSimple(c.height, boundary_of(c), c.lazy, c.adapt);
+            }},
+            {"duptree_block", false, [](const BenchConfig &c) {
+                return new DupTreeBlock(c.height, boundary_of(c), c.lazy, c.adapt);
+            }},
+            {"duptree_child", false, [](const BenchConfig &c) { return new DupTreeChild(c.height, boundary_of(c)); }},
+            {"duptree_plus_simple", false, [](const BenchConfig &c) {
+                return new DupTreePlus<DupTreeSimple>(c.height, c.base_height, c.base_boundary, c.update_threads);
+            }},
+            {"duptree_plus_block", false, [](const BenchConfig &c) {
+                return new DupTreePlus<DupTreeBlock>(c.height, c.base_height, c.base_boundary, c.update_threads);
+            }},
+            {"duptree_plus_child", false, [](const BenchConfig &c) {
+                return new DupTreePlus<DupTreeChild>(c.height, c.base_height, c.base_boundary, c.update_threads);
+            }},
+            {"sparse_simple", true, [](const BenchConfig &c) { return new SparseSimple(c.height); }},
+            {"sparse_balance", true, [](const BenchConfig &c) { return new SparseBalance(c.height); }},
+            {"sparse_mint", true, [](const BenchConfig &c) { return new SparseMint(c.height); }},
+            {"sparse_mint2", true, [](const BenchConfig &c) { return new SparseMint2(c.height); }},
+            {"fat_tree", true, [](const BenchConfig &c) { return new FatTree(c.height); }},
+            {"fat_mint", true, [](const BenchConfig &c) { return new FatMint(c.height); }},
+            {"rat_tree", true, [](const BenchConfig &c) { return new RatTree(c.height); }},
+            {"rat_prefix", true, [](const BenchConfig &c) { return new RatPrefix(c.height); }},
+            {"rat_padding", true, [](const BenchConfig &c) { return new RatPadding(c.height, c.retain, c.gc_rate); }},
+            {"rat_compact", true, [](const BenchConfig &c) { return new RatCompact(c.height, c.retain, c.gc_rate); }},
+    };
+    return registry;
+}
+
+const CheckerEntry *find_checker(const string &name) {
+    for (const auto &entry : checker_registry()) {
+        if (entry.name == name)
+            return &entry;
+    }
+    return nullptr;
+}
+
+IO *make_io(const BenchConfig &config, const string &name) {
+    if (config.io == "leveldb")
+        return new IOLevelDB(name, config.batch_size, config.sync);
+    if (config.io == "memory")
+        return new IOMemory(name);
+    throw invalid_argument("unknown io backend: " + config.io);
+}
+
+void BenchReport::begin(const string &checker) {
+    if (config.format == "text") {
+        out << "\n------ " << checker << " ------\n";
+    }
+}
+
+void BenchReport::add(const BenchRow &row) {
+    if (config.format == "csv") {
+        if (!header) {
+            out << "checker,io,height,boundary,batch_size,workload,phase,stage,ops,micros,io_reads,io_writes,result,"
+                   "op,count,mean_ns,p50_ns,p99_ns,p999_ns,max_ns,total_ns,cycles,instructions,cache_misses\n";
+            header = true;
+        }
+        out << row.checker << ',' << config.io << ',' << config.height << ',' << boundary_of(config) << ','
+            << config.batch_size << ',' << row.workload << ',' << row.phase << ',' << row.stage << ','
+            << row.ops << ',' << row.micros << ',' << row.io_reads << ',' << row.io_writes << ',' << row.result
+            << ",,,,,,,,,,,\n";
+    } else if (config.format == "json") {
+        out << "{\"checker\":" << json_string(row.checker) << ",\"io\":" << json_string(config.io)
+            << ",\"height\":" << config.height << ",\"boundary\":" << boundary_of(config)
+            << ",\"batch_size\":" << config.batch_size << ",\"workload\":" << json_string(row.workload)
+            << ",\"phase\":" << json_string(row.phase) << ",\"stage\":" << json_string(row.stage)
+            << ",\"ops\":" << row.ops << ",\"micros\":" << row.micros
+            << ",\"io_reads\":" << row.io_reads << ",\"io_writes\":" << row.io_writes
+            << ",\"result\":" << json_string(row.result) << "}\n";
+    } else if (row.phase == "init") {
+        out << "-- init end\n";
+    } else if (row.phase == "small_test") {
+        out << "-- small test: " << row.result << '\n';
+    } else if (row.phase == "read") {
+        out << "-- read (generate proof): \t" << right << setw(20) << row.micros << '\n';
+    } else if (row.phase == "write") {
+        out << "-- write (update proof): \t" << right << setw(20) << row.micros << '\n';
+    } else if (row.phase == "stage") {
+        out << "-- Stage " << row.stage << ": \t" << right << setw(20) << row.micros;
+        out << "\t\tread:\t" << row.io_reads << "\twrite:\t" << row.io_writes << '\n';
+    } else {
+        out << "-- " << row.phase << ' ' << row.stage << ": \t" << right << setw(20) << row.micros;
+        out << "\t\tread:\t" << row.io_reads << "\twrite:\t" << row.io_writes;
+        out << (row.result.empty() ? "" : "\t") << row.result << '\n';
+    }
+    if (row.latency != nullptr) {
+        add_latency(row, "update", row.latency->update);
+        add_latency(row, "gen_proof", row.latency->gen_proof);
+        add_latency(row, "verify_proof", row.latency->verify_proof);
+        add_latency(row, "commit", row.latency->commit);
+    }
+    out.flush();
+}
+
+void BenchReport::add_latency(const BenchRow &row, const string &op, const LatencyHistogram &h) {
+    if (h.count() == 0)
+        return;
+    auto p50 = h.percentile(50), p99 = h.percentile(99), p999 = h.percentile(99.9);
+    auto mean = (uint64_t)h.mean();
+    if (config.format == "csv") {
+        out << row.checker << ',' << config.io << ',' << config.height << ',' << boundary_of(config) << ','
+            << config.batch_size << ',' << row.workload << ',' << row.phase << ',' << row.stage << ",,,,,,"
+            << op << ',' << h.count() << ',' << mean << ',' << p50 << ',' << p99 << ',' << p999 << ',' << h.max() << ",,,,\n";
+    } else if (config.format == "json") {
+        out << "{\"checker\":" << json_string(row.checker) << ",\"io\":" << json_string(config.io)
+            << ",\"height\":" << config.height << ",\"boundary\":" << boundary_of(config)
+            << ",\"batch_size\":" << config.batch_size << ",\"workload\":" << json_string(row.workload)
+            << ",\"phase\":" << json_string(row.phase) << ",\"stage\":" << json_string(row.stage)
+            << ",\"op\":" << json_string(op) << ",\"count\":" << h.count() << ",\"mean_ns\":" << mean
+            << ",\"p50_ns\":" << p50 << ",\"p99_ns\":" << p99 << ",\"p999_ns\":" << p999
+            << ",\"max_ns\":" << h.max() << "}\n";
+    } else {
+        auto us = [](uint64_t ns) {
+            ostringstream ss;
+            ss << fixed << setprecision(1) << (double)ns / 1000.0;
+            return ss.str();
+        };
+        out << "--   " << left << setw(14) << op << right << "n:" << setw(10) << h.count()
+            << "\tp50:" << setw(10) << us(p50) << "\tp99:" << setw(10) << us(p99)
+            << "\tp999:" << setw(10) << us(p999) << "\tmax:" << setw(12) << us(h.max()) << "  (us)\n";
+    }
+}
+
+void BenchReport::add_profile(const string &checker, const vector<prof::PhaseStats> &phases) {
+    uint64_t total = 0;
+    for (const auto &p : phases) {
+        total += p.ns;
+    }
+    if (config.format == "text") {
+        out << "-- profile" << setw(12) << "calls" << setw(12) << "ms" << setw(8) << "share" << setw(16) << "cycles"
+            << setw(16) << "instructions" << setw(6) << "IPC" << setw(14) << "cache misses" << '\n';
+    }
+    for (const auto &p : phases) {
+        if (p.calls == 0)
+            continue;
+        if (config.format == "csv") {
+            out << checker << ',' << config.io << ',' << config.height << ',' << boundary_of(config) << ','
+                << config.batch_size << ',' << config.workload << ",profile,,,,,,," << p.name << ',' << p.calls << ','
+                << p.ns / p.calls << ",,,,," << p.ns << ',' << p.cycles << ',' << p.instructions << ',' << p.cache_misses << '\n';
+        } else if (config.format == "json") {
+            out << "{\"checker\":" << json_string(checker) << ",\"io\":" << json_string(config.io)
+                << ",\"height\":" << config.height << ",\"boundary\":" << boundary_of(config)
+                << ",\"batch_size\":" << config.batch_size << ",\"workload\":" << json_string(config.workload)
+                << ",\"phase\":\"profile\",\"op\":" << json_string(p.name) << ",\"count\":" << p.calls
+                << ",\"total_ns\":" << p.ns << ",\"cycles\":" << p.cycles << ",\"instructions\":" << p.instructions
+                << ",\"cache_misses\":" << p.cache_misses << "}\n";
+        } else {
+            double ipc = p.cycles == 0 ? 0 : (double)p.instructions / (double)p.cycles;
+            out << "--   " << left << setw(10) << p.name << right << setw(10) << p.calls
+                << setw(12) << fixed << setprecision(1) << (double)p.ns / 1e6
+                << setw(7) << (total == 0 ? 0.0 : 100.0 * (double)p.ns / (double)total) << '%'
+                << setw(16) << p.cycles << setw(16) << p.instructions << setw(6) << setprecision(2) << ipc
+                << setw(14) << p.cache_misses << '\n';
+            out.unsetf(ios::floatfield);
+            out << setprecision(6);
+        }
+    }
+    out.flush();
+}
+
+int run_bench(const BenchConfig &config) {
+    vector<const CheckerEntry *> entries;
+    for (const auto &name : config.checkers) {
+        const CheckerEntry *entry = find_checker(name);
+        if (entry == nullptr) {
+            cerr << "unknown checker: " << name << endl;
+            return EXIT_FAILURE;
+        }
+        if (config.workload == "eth" && !entry->hex_keys) {
+            cerr << name << " does not take trace keys" << endl;
+            return EXIT_FAILURE;
+        }
+        entries.push_back(entry);
+    }
+    if (config.workload != "eth" && config.workload != "random" && config.workload != "uniform" &&
+        config.workload != "zipf" && config.workload != "sequential" && config.workload != "hotset") {
+        cerr << "unknown workload: " << config.workload << endl;
+        return EXIT_FAILURE;
+    }
+    if (!config.import_path.empty() && config.import_roots.size() != entries.size()) {
+        cerr << "import needs import_root with one digest per checker" << endl;
+        return EXIT_FAILURE;
+    }
+
+    ofstream file;
+    if (!config.output.empty()) {
+        file.open(config.output);
+        if (!file) {
+            cerr << "open output error: " << config.output << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    BenchReport report(config, config.output.empty() ? cout : file);
+
+    if (config.profile) {
+        prof::enable();
+        if (!prof::hardware_counters()) {
+            cerr << "perf_event_open not permitted, profiling wall time only" << endl;
+        }
+    }
+
+    int status = 0;
+    for (size_t e = 0; e < entries.size(); ++e) {
+        const CheckerEntry *entry = entries[e];
+        // before the checker, whose destructor may still discard into it
+        unique_ptr<IO> io;
+        unique_ptr<MemChecker> checker(entry->make(config));
+        string db_name = "db_" + checker->get_name();
+        auto logged = [&](MemChecker *c) -> MemChecker * {
+            return config.wal > 0 ? new LoggedChecker(c, db_name + ".wal", config.wal, config.checkpoint) : c;
+        };
+        checker.reset(logged(checker.release()));
+        CachedChecker *cached = nullptr;
+        if (config.proof_cache > 0) {
+            cached = new CachedChecker(checker.release(), (size_t)config.proof_cache);
+            checker.reset(cached);
+        }
+        io.reset(make_io(config, db_name));
+        report.begin(checker->get_name());
+        auto finish = [&] {
+            // writes after the last commit go with the checker
+            checker.reset();
+            if (config.profile) {
+                report.add_profile(entry->name, prof::report());
+                prof::reset();
+            }
+            if (config.delete_db) {
+                io->destroy();
+                if (config.wal > 0)
+                    UpdateLog(db_name + ".wal").destroy();
+            }
+        };
+
+        auto start = Clock::now();
+        if (!config.import_path.empty()) {
+            snapshot::Stats st;
+            string path = config.import_path + "." + entry->name;
+            bool ok = false;
+            try {
+                ok = snapshot::load(checker.get(), io.get(), path, config.import_roots[e], &st, config.update_threads);
+            } catch (const invalid_argument &ex) {
+                cerr << ex.what() << endl;
+            }
+            if (!ok) {
+                cerr << "import error: " << path << endl;
+                status = EXIT_FAILURE;
+                finish();
+                continue;
+            }
+            BenchRow row{entry->name, config.workload, "import", "", st.records, nanos_since(start) / 1000};
+            row.result = snapshot_result(st) + " root " + config.import_roots[e];
+            report.add(row);
+        } else if (!checker->init(io.get(), config.create_db, nullptr)) {
+            cerr << "open database error: " << io->get_name() << endl;
+            return EXIT_FAILURE;
+        } else {
+            report.add(BenchRow{entry->name, config.workload, "init", "", 0, nanos_since(start) / 1000});
+        }
+
+        if (config.workload == "eth") {
+            run_eth(config, *entry, checker.get(), report);
+        } else if (config.workload != "random") {
+            run_synthetic(config, *entry, checker.get(), report);
+        } else if (!run_random(config, *entry, checker.get(), io.get(), report)) {
+            status = EXIT_FAILURE;
+        }
+
+        if (cached != nullptr) {
+            const auto &st = cached->cache_stats();
+            BenchRow row{entry->name, config.workload, "proof_cache", "", st.hits + st.misses, 0};
+            ostringstream result;
+            result << "hits " << st.hits << " misses " << st.misses << " hit_rate " << fixed << setprecision(3)
+                   << st.hit_rate() << " evictions " << st.evictions << " invalidations " << st.invalidations;
+            row.result = result.str();
+            report.add(row);
+        }
+
+        if (!config.export_path.empty()) {
+            snapshot::Stats st;
+            string path = config.export_path + "." + entry->name;
+            start = Clock::now();
+            bool ok = false;
+            try {
+                ok = snapshot::save(checker.get(), checker->get_digest(), path, &st, 1 << 22, config.update_threads);
+            } catch (const invalid_argument &ex) {
+                cerr << ex.what() << endl;
+            }
+            if (!ok) {
+                cerr << "export error: " << path << endl;
+                status = EXIT_FAILURE;
+            } else {
+                BenchRow row{entry->name, config.workload, "export", "", st.records, nanos_since(start) / 1000};
+                row.result = snapshot_result(st) + " root " + checker->get_digest();
+                report.add(row);
+            }
+        }
+
+        if (config.reopen) {
+            // a new checker over the database as the last commit left it
+            string root = checker->get_digest();
+            checker.reset(logged(entry->make(config)));
+            BenchRow row{entry->name, config.workload, "reopen", "", 1};
+            start = Clock::now();
+            bool ok = checker->init(io.get(), false, nullptr);
+            row.micros = nanos_since(start) / 1000;
+            row.result = ok && checker->get_digest() == root ? "passed" : "failed";
+            report.add(row);
+            if (row.result != "passed")
+                status = EXIT_FAILURE;
+        }
+
+        finish();
+    }
+    return status;
+}
@@ -0,0 +1,118 @@
+#ifndef DUPTREE_BENCH_HPP
+#define DUPTREE_BENCH_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <ostream>
+#include "mem_checker.hpp"
+#include "histogram.hpp"
+#include "workload.hpp"
+#include "profiler.hpp"
+
+// Everything a benchmark run can be told from the command line or a config
+// file, as key=value pairs (see bench_usage()).
+struct BenchConfig {
+    std::vector<std::string> checkers{"rat_tree", "rat_padding", "rat_compact"};
+    std::string io = "leveldb"; // leveldb | memory
+    Int height = 40;
+    Int boundary = 0; // duptree height boundary, 0 means height
+    Int base_height = 4; // duptree_plus inner tree height
+    Int base_boundary = 4;
+    Int lazy = -1; // duptree: block writes per commit from the lazy table, -1 copies eagerly
+    Int adapt = 0; // duptree: ops per boundary re-evaluation, 0 keeps the boundary fixed
+    Int retain = 0; // rat_compact, rat_padding: versions kept, 0 never deletes superseded nodes
+    Int gc_rate = 0; // superseded nodes deleted per commit, 0 means all that are due
+    Int batch_size = 10000;
+    bool sync = false;
+    bool create_db = true, delete_db = true;
+    bool reopen = false; // after the workload, time init(io, false) of a new checker on the same database
+    Int wal = 0; // updates per sync of a LoggedChecker update log (run with sync=0), 0 means no log
+    Int checkpoint = 100; // wal: commits per background sync of io
+    std::string export_path; // after the workload, snapshot each checker to export_path.<checker>
+    std::string import_path; // start each checker from the snapshot import_path.<checker> instead of init
+    std::vector<std::string> import_roots; // import: the root digest each checker's snapshot must hold, in checkers order
+
+    std::string workload = "eth"; // eth | random | uniform | zipf | sequential | hotset
+    std::vector<std::string> traces{"eth00.txt", "eth01.txt", "eth02.txt", "eth03.txt"};
+    Int first_block = 0, last_block = -1; // block range of each trace, -1 means to the end
+    Int samples = 1000000; // random workload: ops per phase
+    Int flush_every = 10000; // random workload: explicit flush period, 0 means never
+    Int write_batch = 0; // random workload: updates per update_batch() call, 0 or 1 calls update()
+    int update_threads = 0; // duptree_plus update_batch() and verify_batch() workers, 0 means hardware threads
+    Int stage = 100000; // blocks per stage report
+    int threads = 0; // trace parsing threads, 0 means hardware threads - 1
+    WorkloadConfig synthetic; // generated workloads; distribution is taken from workload
+    Int keys = 0; // generated workloads: key space, 0 means 2^height
+    bool verify = false; // also time verify_proof on proofs whose value is known
+    bool binary_proofs = false; // gen_proof_binary and verifier::verify instead
+    Int verify_batch = 0; // random workload, binary_proofs: proofs per verifier::verify_batch() call
+    Int proof_cache = 0; // bytes of gen_proof results kept per root digest, 0 means no cache
+    bool profile = false; // per-phase perf counters, see profiler.hpp
+
+    std::string format = "text"; // text | csv | json (one object per line)
+    std::string output; // empty means stdout
+};
+
+void bench_set(BenchConfig &config, const std::string &key, const std::string &value);
+void bench_load(BenchConfig &config, const std::string &path);
+// Applies "key=value" arguments in order; "config=path" loads a file in place.
+void bench_parse(BenchConfig &config, int argc, char **argv, int first = 1);
+std::string bench_usage();
+
+struct CheckerEntry {
+    std::string name;
+    bool hex_keys; // takes 40-hex trace keys, otherwise itos() positions
+    std::function<MemChecker *(const BenchConfig &)> make;
+};
+
+const std::vector<CheckerEntry> &checker_registry();
+const CheckerEntry *find_checker(const std::string &name);
+IO *make_io(const BenchConfig &config, const std::string &name);
+
+// Per-operation latencies of one phase.
+struct OpLatency {
+    LatencyHistogram update, gen_proof, verify_proof, commit;
+
+    void merge(const OpLatency &o) {
+        update.merge(o.update);
+        gen_proof.merge(o.gen_proof);
+        verify_proof.merge(o.verify_proof);
+        commit.merge(o.commit);
+    }
+    void reset() {
+        update.reset();
+        gen_proof.reset();
+        verify_proof.reset();
+        commit.reset();
+    }
+};
+
+// One measured phase of one checker.
+struct BenchRow {
+    std::string checker, workload, phase, stage;
+    Int ops = 0;
+    Int micros = 0;
+    Int io_reads = 0, io_writes = 0; // as reported by commit()
+    std::string result; // e.g. passed/failed for correctness checks
+    const OpLatency *latency = nullptr; // reported as one extra line per non-empty histogram
+};
+
+class BenchReport {
+    const BenchConfig &config;
+    std::ostream &out;
+    bool header = false;
+
+    void add_latency(const BenchRow &row, const std::string &op, const LatencyHistogram &h);
+
+public:
+    BenchReport(const BenchConfig &config, std::ostream &out) : config(config), out(out) {}
+
+    void begin(const std::string &checker);
+    void add(const BenchRow &row);
+    void add_profile(const std::string &checker, const std::vector<prof::PhaseStats> &phases);
+};
+
+int run_bench(const BenchConfig &config);
+
+#endif //DUPTREE_BENCH_HPP
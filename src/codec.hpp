@@ -0,0 +1,193 @@
+#ifndef DUPTREE_CODEC_HPP
+#define DUPTREE_CODEC_HPP
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include "tools.hpp"
+#include "profiler.hpp"
+
+// Binary record shared by the prefix-tree node classes.
+//
+//   [version][flags][prefix][hash]?  leaf:   [value]
+//                                    branch: ([bitmap16][key]*)? ([bitmap16][digest]*)?
+//
+// Strings are varint length-prefixed and digests are packed into 32 bytes. Only
+// children whose bit is set in the occupancy bitmap are stored.
+namespace codec {
+    const unsigned char VERSION = 1;
+
+    const unsigned char LEAF = 1;
+    const unsigned char SELF_HASH = 2;
+    const unsigned char CHILD_KEYS = 4;
+    const unsigned char CHILD_HASHES = 8;
+
+    const size_t DIGEST_SIZE = 32;
+
+    struct Record {
+        bool isLeaf = false;
+        std::string prefix, hash, value;
+        std::vector<std::string> keys, hashes;
+    };
+
+    inline void put_varint(std::string &out, size_t v) {
+        while (v >= 0x80) {
+            out.push_back(char((v & 0x7f) | 0x80));
+            v >>= 7;
+        }
+        out.push_back(char(v));
+    }
+
+    inline size_t get_varint(const std::string &in, size_t &pos) {
+        size_t v = 0;
+        for (int shift = 0; ; shift += 7) {
+            if (pos >= in.length() || shift > 63)
+                throw std::invalid_argument("truncated node record");
+            auto c = (unsigned char)in[pos++];
+            v |= size_t(c & 0x7f) << shift;
+            if ((c & 0x80) == 0)
+                return v;
+        }
+    }
+
+    inline void put_bytes(std::string &out, const std::string &s) {
+        put_varint(out, s.length());
+        out.append(s);
+    }
+
+    inline std::string get_bytes(const std::string &in, size_t &pos) {
+        size_t len = get_varint(in, pos);
+        if (pos + len > in.length())
+            throw std::invalid_argument("truncated node record");
+        pos += len;
+        return in.substr(pos - len, len);
+    }
+
+    inline void put_digest(std::string &out, const std::string &hex) {
+        if (hex.length() != DIGEST_SIZE * 2)
+            throw std::invalid_argument("invalid digest length");
+        out.append(hex_to_bytes(hex));
+    }
+
+    inline std::string get_digest(const std::string &in, size_t &pos) {
+        if (pos + DIGEST_SIZE > in.length())
+            throw std::invalid_argument("truncated node record");
+        pos += DIGEST_SIZE;
+        return bytes_to_hex(in.data() + pos - DIGEST_SIZE, DIGEST_SIZE);
+    }
+
+    inline void put_children(std::string &out, const std::vector<std::string> &children, bool digests) {
+        unsigned bitmap = 0;
+        for (size_t i = 0; i < children.size(); ++i) {
+            if (!children[i].empty())
+                bitmap |= 1u << i;
+        }
+        out.push_back(char(bitmap & 0xff));
+        out.push_back(char(bitmap >> 8));
+        for (const auto &c : children) {
+            if (c.empty())
+                continue;
+            if (digests)
+                put_digest(out, c);
+            else
+                put_bytes(out, c);
+        }
+    }
+
+    inline void get_children(const std::string &in, size_t &pos, std::vector<std::string> &children, size_t width, bool digests) {
+        if (pos + 2 > in.length())
+            throw std::invalid_argument("truncated node record");
+        unsigned bitmap = (unsigned char)in[pos] | ((unsigned char)in[pos + 1] << 8);
+        pos += 2;
+        children.assign(width, "");
+        for (size_t i = 0; i < width; ++i) {
+            if (bitmap & (1u << i))
+                children[i] = digests ? get_digest(in, pos) : get_bytes(in, pos);
+        }
+    }
+
+    inline std::string encode_leaf(const std::string &prefix, const std::string *hash, const std::string &value) {
+        prof::Scope scope(prof::ENCODE);
+        std::string out;
+        out.reserve(prefix.length() + value.length() + DIGEST_SIZE + 8);
+        out.push_back(char(VERSION));
+        out.push_back(char(LEAF | (hash != nullptr ? SELF_HASH : 0)));
+        put_bytes(out, prefix);
+        if (hash != nullptr)
+            put_digest(out, *hash);
+        put_bytes(out, value);
+        return out;
+    }
+
+    inline std::string encode_branch(const std::string &prefix, const std::string *hash,
+                                     const std::vector<std::string> *keys, const std::vector<std::string> *hashes) {
+        prof::Scope scope(prof::ENCODE);
+        std::string out;
+        out.push_back(char(VERSION));
+        out.push_back(char((hash != nullptr ? SELF_HASH : 0) | (keys != nullptr ? CHILD_KEYS : 0) | (hashes != nullptr ? CHILD_HASHES : 0)));
+        put_bytes(out, prefix);
+        if (hash != nullptr)
+            put_digest(out, *hash);
+        if (keys != nullptr)
+            put_children(out, *keys, false);
+        if (hashes != nullptr)
+            put_children(out, *hashes, true);
+        return out;
+    }
+
+    // An empty (never written) record decodes as a branch without children.
+    inline void decode(const std::string &in, Record &rec, size_t width = 16) {
+        prof::Scope scope(prof::DECODE);
+        if (in.empty()) {
+            rec.isLeaf = false;
+            rec.keys.assign(width, "");
+            rec.hashes.assign(width, "");
+            return;
+        }
+        if (in.length() < 2 || (unsigned char)in[0] != VERSION)
+            throw std::invalid_argument("unsupported node record version");
+        auto flags = (unsigned char)in[1];
+        size_t pos = 2;
+        rec.isLeaf = (flags & LEAF) != 0;
+        rec.prefix = get_bytes(in, pos);
+        if (flags & SELF_HASH)
+            rec.hash = get_digest(in, pos);
+        if (rec.isLeaf) {
+            rec.value = get_bytes(in, pos);
+            return;
+        }
+        if (flags & CHILD_KEYS)
+            get_children(in, pos, rec.keys, width, false);
+        else
+            rec.keys.assign(width, "");
+        if (flags & CHILD_HASHES)
+            get_children(in, pos, rec.hashes, width, true);
+        else
+            rec.hashes.assign(width, "");
+    }
+
+    // decode() of a record that may be damaged: false instead of a throw.
+    inline bool try_decode(const std::string &in, Record &rec, size_t width = 16) {
+        try {
+            decode(in, rec, width);
+        } catch (const std::invalid_argument &) {
+            return false;
+        }
+        return true;
+    }
+
+    // The node's own hash, without decoding its children. A missing record has no hash.
+    inline std::string peek_hash(const std::string &in) {
+        prof::Scope scope(prof::DECODE);
+        if (in.empty())
+            return "";
+        if (in.length() < 2 || (unsigned char)in[0] != VERSION || ((unsigned char)in[1] & SELF_HASH) == 0)
+            throw std::invalid_argument("node record carries no hash");
+        size_t pos = 2;
+        size_t len = get_varint(in, pos);
+        pos += len;
+        return get_digest(in, pos);
+    }
+}
+
+#endif //DUPTREE_CODEC_HPP
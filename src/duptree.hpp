@@ -3,18 +3,363 @@
 
 #include <utility>
 #include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
 #include "tools.hpp"
 #include "io.hpp"
 #include "mem_checker.hpp"
 #include "node.hpp"
 
+// Lazy mode (lazy_budget >= 0): a new upper-level hash is not copied into the
+// blocks under its node at once but kept in a side table keyed by that node,
+// which overrides the stored copies when a block is read. commit() copies the
+// oldest entries into their blocks, spending at most lazy_budget block writes
+// and taking an entry wider than that a part at a time. Each entry left is
+// saved as its own "lazy:<node>" record, rewritten only when it changed, and
+// "lazy" lists their nodes, so that a reopened tree still proves right.
+//
+// Adaptive mode (adapt_window > 0): update() and gen_proof() are timed, and
+// every adapt_window ops commit() fits a read and a write cost to the window
+// and moves height_boundary one level up or down when the IO model says the
+// mix would have been cheaper there by more than the move costs. A move goes
+// MOVE_UNITS subtrees per commit: the subtrees at level min(from, to) before
+// the cursor have their blocks at the new level, the rest at the old one,
+// and the records of the old layout are removed as each one moves. The
+// boundary, and while it moves the target and cursor, are saved under
+// "boundary".
 class DupTree : public MerkleBase {
+    struct LazyHash {
+        std::string hash;
+        Int level, version;
+        Int done = 0; // positions at the start of the range copied already, see copy_range()
+        bool listed = false; // in the saved "lazy" list
+    };
+
+    static const Int MOVE_UNITS = 4096;
+
+    Int lazy_budget, version = 0;
+    Int adapt_window, window_updates = 0, window_proofs = 0, window_commits = 0;
+    Int move_to = 0, cursor = 0; // boundary being moved to, 0 if none, and the next subtree to move
+    double update_ns = 0, proof_ns = 0;
+    std::map<Int, LazyHash> lazy;
+    std::map<Int, Int> by_version; // version -> node of every entry in lazy
+    std::set<Int> dirty; // nodes whose "lazy:" record is out of date
+
+    static std::string lazy_key(Int node) {
+        return "lazy:" + itos(node);
+    }
+
+    void drop_lazy(std::map<Int, LazyHash>::iterator it) {
+        by_version.erase(it->second.version);
+        dirty.insert(it->first);
+        lazy.erase(it);
+    }
+
+    // Level of the subtrees a move goes by, and the lower of the two block
+    // levels; both are height_boundary when no move is on.
+    Int unit_height() const {
+        return move_to == 0 ? height_boundary : std::min(height_boundary, move_to);
+    }
+    Int fine_height() const {
+        return move_to == 0 ? height_boundary : std::max(height_boundary, move_to);
+    }
+
+    // Block level of the subtree holding id, which sits at unit_height() or below.
+    Int height_at(Int id) const {
+        if (move_to == 0)
+            return height_boundary;
+        return id >> (level_of(id) - unit_height()) < cursor ? move_to : height_boundary;
+    }
+
+    // Number of positions at fine_height() under node.
+    Int span(Int node) const {
+        Int f = 1LL << fine_height();
+        return up_to_max(node, f) - up_to(node, f) + 1;
+    }
+
+    // Sets level in the blocks under node from position done on, positions
+    // being the nodes at fine_height() under it; a block one level higher
+    // covers two. Spends at most budget block writes and returns the
+    // positions done.
+    Int copy_range(Int node, Int done, Int &budget, Int level, const std::string &key) {
+        Int f = 1LL << fine_height();
+        Int l = up_to(node, f), r = up_to_max(node, f), p = l + done;
+        while (p <= r && budget > 0) {
+            Int shift = fine_height() - height_at(p), q = r;
+            if (move_to != 0) {
+                Int moved = cursor << (fine_height() - unit_height());
+                if (p < moved)
+                    q = std::min(r, moved - 1);
+            }
+            Int b = p >> shift, n = std::min((q >> shift) - b + 1, budget);
+            modify_range(b, b + n - 1, level, key);
+            budget -= n;
+            p = (b + n) << shift;
+        }
+        return p - l;
+    }
+
+    void set_level(Int node, Int level, const std::string &key) {
+        auto it = lazy.find(node);
+        bool listed = false;
+        if (it != lazy.end()) {
+            listed = it->second.listed;
+            drop_lazy(it);
+        }
+        if (lazy_budget < 0) {
+            Int budget = std::numeric_limits<Int>::max();
+            copy_range(node, 0, budget, level, key);
+        } else {
+            lazy[node] = {key, level, ++version, 0, listed};
+            by_version[version] = node;
+            dirty.insert(node);
+        }
+    }
+
+    void read_levels(Int id, std::vector<std::string> &self_proofs) {
+        read_self(id, self_proofs);
+        if (lazy.empty())
+            return;
+        for (size_t k = 0; k < self_proofs.size(); ++k, id /= 2) {
+            auto it = lazy.find(id);
+            if (it != lazy.end())
+                self_proofs[k] = it->second.hash;
+        }
+    }
+
+    // Oldest first; the last entry the budget reaches may be copied in part
+    // and goes on where it stopped at the next commit.
+    void compact(Int budget) {
+        while (budget > 0 && !by_version.empty()) {
+            Int node = by_version.begin()->second;
+            auto it = lazy.find(node);
+            LazyHash &e = it->second;
+            e.done = copy_range(node, e.done, budget, e.level, e.hash);
+            if (e.done >= span(node)) {
+                drop_lazy(it);
+            } else {
+                dirty.insert(node);
+            }
+        }
+    }
+
+    // Writes the records of the entries changed since the last commit, and
+    // the list of their nodes that load_lazy() reads if an entry came or went.
+    void save_lazy() {
+        bool relist = false;
+        for (Int node : dirty) {
+            auto it = lazy.find(node);
+            if (it == lazy.end()) {
+                io->remove(lazy_key(node));
+                relist = true;
+            } else {
+                LazyHash &e = it->second;
+                io->write(lazy_key(node), itos(e.level) + "," + itos(e.version) + "," + itos(e.done) + ","
+                                          + e.hash);
+                relist = relist || !e.listed;
+                e.listed = true;
+            }
+        }
+        dirty.clear();
+        if (relist) {
+            std::string nodes;
+            for (const auto &e : lazy) {
+                nodes.append(nodes.empty() ? "" : ",").append(itos(e.first));
+            }
+            io->write("lazy", nodes);
+        }
+    }
+
+    // An entry saved under another boundary would patch blocks that are not there.
+    bool lazy_fits(Int node, Int level) const {
+        return level >= 2 && level <= fine_height() && node >> (level - 1) == 1;
+    }
+
+    // Reads the entries of the nodes "lazy" lists, and nothing else.
+    void load_lazy() {
+        std::string list, s;
+        if (!io->read("lazy", list))
+            return;
+        for (size_t p = 0, q; p < list.size(); p = q + 1) {
+            q = std::min(list.find(',', p), list.size());
+            Int node = std::stoll(list.substr(p, q - p));
+            if (!io->read(lazy_key(node), s)) {
+                dirty.insert(node);
+                continue;
+            }
+            size_t a = s.find(','), b = s.find(',', a + 1), c = s.find(',', b + 1);
+            LazyHash e{s.substr(c + 1), std::stoll(s.substr(0, a)), std::stoll(s.substr(a + 1, b - a - 1)),
+                       std::stoll(s.substr(b + 1, c - b - 1)), true};
+            if (!lazy_fits(node, e.level)) {
+                dirty.insert(node);
+                continue;
+            }
+            lazy[node] = e;
+            by_version[e.version] = node;
+            version = std::max(version, e.version);
+        }
+    }
+
+    // IO model of one op at boundary h. Eager, an update copies its upper
+    // levels into every block; lazy, the copies are what commit() spends of
+    // lazy_budget, spread over the updates of the window.
+    double update_reads(Int h) const {
+        return (double)(height - h + high_reads(h));
+    }
+    double update_writes(Int h) const {
+        auto copies = (double)((1LL << (h - 1)) - 1);
+        if (lazy_budget >= 0 && window_updates > 0)
+            copies = std::min(copies, (double)lazy_budget * (double)window_commits / (double)window_updates);
+        return (double)(height - h + 1) + copies;
+    }
+    double proof_reads(Int h) const {
+        return (double)(height - h + high_reads(h));
+    }
+
+    void adapt() {
+        Int ops = window_updates + window_proofs;
+        if (ops == 0 || ops < adapt_window)
+            return;
+        Int h = height_boundary;
+        double cr, cw;
+        if (window_proofs > 0) {
+            cr = proof_ns / ((double)window_proofs * proof_reads(h));
+            cw = cr;
+            if (window_updates > 0) {
+                double per_update = update_ns / (double)window_updates - update_reads(h) * cr;
+                cw = std::max(per_update / update_writes(h), cr * 0.1);
+            }
+        } else {
+            cr = cw = update_ns / ((double)window_updates * (update_reads(h) + update_writes(h)));
+        }
+        auto cost = [&](Int b) {
+            return (double)window_updates * (update_reads(b) * cr + update_writes(b) * cw)
+                   + (double)window_proofs * proof_reads(b) * cr;
+        };
+        Int best = h;
+        for (Int b : {h - 1, h + 1}) {
+            if (b >= 2 && b <= height && cost(b) < cost(best))
+                best = b;
+        }
+        double move = (double)(1LL << (h - 1)) * (2 * cr + 2 * cw);
+        if (best != h && cost(best) < 0.9 * cost(h) && cost(h) - cost(best) > move)
+            start_move(best);
+        clear_window();
+    }
+
+    void clear_window() {
+        window_updates = window_proofs = window_commits = 0;
+        update_ns = proof_ns = 0;
+    }
+
+    void set_boundary(Int h) {
+        height_boundary = h;
+        boundary = 1LL << h;
+    }
+
+    // Positions are counted at fine_height(), which changes as a move up
+    // starts and as a move down ends; a position cut in two is copied again.
+    void rescale_lazy(bool finer) {
+        for (auto &e : lazy) {
+            if (e.second.done != 0) {
+                e.second.done = finer ? e.second.done * 2 : e.second.done / 2;
+                dirty.insert(e.first);
+            }
+        }
+    }
+
+    void start_move(Int to) {
+        move_to = to;
+        cursor = 1LL << (unit_height() - 1);
+        if (to > height_boundary)
+            rescale_lazy(true);
+    }
+
+    // Moves the next MOVE_UNITS subtrees and ends the move after the last.
+    void move_step() {
+        flush_levels();
+        Int end = 1LL << unit_height();
+        for (Int n = 0; n < MOVE_UNITS && cursor < end; ++n, ++cursor) {
+            move_unit(cursor);
+        }
+        if (cursor == end) {
+            bool coarser = move_to < height_boundary;
+            set_boundary(move_to);
+            move_to = cursor = 0;
+            if (coarser)
+                rescale_lazy(false);
+        }
+    }
+
+    // Going down, the two old blocks under a get node records and a takes the
+    // upper levels of the left one; going up, a is split in two. Levels are
+    // read through the lazy table, so entries not copied yet carry over.
+    void move_unit(Int a) {
+        Int from = height_boundary;
+        std::vector<std::string> left, right;
+        if (move_to < from) {
+            read_levels(a * 2, left);
+            read_levels(a * 2 + 1, right);
+            for (Int c : {a * 2, a * 2 + 1}) {
+                remove_block(c);
+                auto it = lazy.find(c);
+                if (it != lazy.end())
+                    drop_lazy(it);
+            }
+            io->write(itos(a * 2), right[0]);
+            io->write(itos(a * 2 + 1), left[0]);
+            for (Int i = move_to; i > 1; i--) {
+                modify_id_level(a, i, left[from - i]);
+            }
+        } else {
+            std::string hl, hr;
+            read_levels(a, left);
+            io->read(itos(a * 2), hl);
+            io->read(itos(a * 2 + 1), hr);
+            remove_block(a);
+            io->remove(itos(a * 2));
+            io->remove(itos(a * 2 + 1));
+            modify_id_level(a * 2, move_to, hr);
+            modify_id_level(a * 2 + 1, move_to, hl);
+            for (Int i = from; i > 1; i--) {
+                modify_id_level(a * 2, i, left[from - i]);
+                modify_id_level(a * 2 + 1, i, left[from - i]);
+            }
+        }
+    }
+
 protected:
     Int boundary, height_boundary;
 
+    // Level of node id, the root being 1. A block keeps the levels from its
+    // own down to 2, which while the boundary moves is not the same for all.
+    static Int level_of(Int id) {
+        return 64 - __builtin_clzll((unsigned long long)id);
+    }
+
+    // Reads per get_high() / read_self() at boundary h.
+    virtual Int high_reads(Int h) const = 0;
+
+    // Removes the records of block id, left behind when the boundary moves.
+    virtual void remove_block(Int id) = 0;
     virtual void modify_id_level(Int id, Int level, const std::string &key) = 0;
     virtual void read_self(Int id, std::vector<std::string> &self_proofs) = 0;
     virtual void get_high(Int id, std::string &output) = 0;
+    // Visits the records that hold the levels of block id, false if one is missing.
+    virtual bool walk_block(Int id, const Visit &visit) = 0;
+    // Sets level of every block in [l, r].
+    virtual void modify_range(Int l, Int r, Int level, const std::string &key) {
+        for (Int i = l; i <= r; ++i) {
+            modify_id_level(i, level, key);
+        }
+    }
+    // Writes out upper-level changes held back by the subclass.
+    virtual void flush_levels() {}
 
     Node gen_node(Int id, Int level, std::string *values) {
         if (id >= num_leaf) {
@@ -29,128 +374,323 @@ protected:
             io->write(itos(id), node.to_string());
         } else if (id != 1) {
             Int sibling = id / 2 * 4 + 1 - id;
-            Int l = up_to(sibling, boundary);
-            Int r = up_to_max(sibling, boundary);
-            for (Int i = l; i <= r; ++i) {
-                modify_id_level(i, level, node.get_hash_val());
-            }
+            modify_range(up_to(sibling, boundary), up_to_max(sibling, boundary), level, node.get_hash_val());
         }
         return node;
     }
 
 public:
-    explicit DupTree(Int height, Int height_boundary) : MerkleBase(height) {
+    explicit DupTree(Int height, Int height_boundary, Int lazy_budget = -1, Int adapt_window = 0)
+            : MerkleBase(height) {
         this->boundary = 1LL << height_boundary;
         this->height_boundary = height_boundary;
+        this->lazy_budget = lazy_budget;
+        this->adapt_window = adapt_window;
+    }
+
+    Int get_boundary() const {
+        return height_boundary;
     }
 
     bool init(IO *io, bool create_db, std::string *values) override {
         this->io = io;
-        if (!this->io->open()) {
+        if (!this->io->open(create_db)) {
             return false;
         }
+        lazy.clear();
+        by_version.clear();
+        dirty.clear();
+        version = 0;
+        move_to = cursor = 0;
         if (create_db) {
             digest = gen_node(1, 1, values).get_hash_val();
             io->write("1", digest);
-            this->io->flush();
+            flush_levels();
+            MerkleBase::commit();
         } else {
-            io->read("1", digest);
+            // "1" is only the digest at creation; nested trees are reread
+            // per block and do not need it
+            std::vector<Int> counters;
+            if (nested) {
+                io->read("1", digest);
+            } else if (!recover(digest, counters)) {
+                return false;
+            }
+            std::string h;
+            if (io->read("boundary", h)) {
+                size_t a = h.find(','), b = h.find(',', a + 1);
+                set_boundary(std::stoll(h.substr(0, a)));
+                if (a != std::string::npos) {
+                    move_to = std::stoll(h.substr(a + 1, b - a - 1));
+                    cursor = std::stoll(h.substr(b + 1));
+                }
+            }
+            load_lazy();
         }
         return true;
     }
 
     void update(const std::string &spos, const std::string &value) override {
+        auto start = std::chrono::steady_clock::now();
         std::string key = value;
         Int pos = std::stoi(spos);
         io->write(itos(pos + num_leaf), key);
         std::string s;
         Int id = pos + num_leaf;
-        for (; id >= boundary; id /= 2) {
+        Int hb = height_at(id), b = 1LL << hb;
+        for (; id >= b; id /= 2) {
             io->read(itos(id / 2 * 4 + 1 - id), s);
             key = calculateSHA256Hash((id & 1) == 0 ? key.append(s) : s.append(key));
-            if (id / 2 >= boundary)
+            if (id / 2 >= b)
                 io->write(itos(id / 2), key);
         }
 
         std::vector<std::string> self_proofs;
-        read_self(id, self_proofs);
+        read_levels(id, self_proofs);
 
-        for (Int i = height_boundary; i > 1; i--, id /= 2) {
-            Int sibling = id / 2 * 4 + 1 - id;
-            Int l = up_to(sibling, boundary);
-            Int r = up_to_max(sibling, boundary);
-            for (Int j = l; j <= r; ++j) {
-                modify_id_level(j, i, key);
-            }
+        for (Int i = hb; i > 1; i--, id /= 2) {
+            set_level(id / 2 * 4 + 1 - id, i, key);
 
-            s = self_proofs[height_boundary - i];
+            s = self_proofs[hb - i];
             key = calculateSHA256Hash((id & 1) == 0 ? key.append(s) : s.append(key));
         }
         digest = key;
+        if (adapt_window > 0) {
+            ++window_updates;
+            update_ns += (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+    std::pair<Int, Int> commit() override {
+        // a move step changes the positions of the lazy table, so it goes
+        // first and "lazy" is saved with the boundary it counts by
+        if (adapt_window > 0) {
+            ++window_commits;
+            if (move_to != 0) {
+                // the window would time a mix of both layouts
+                move_step();
+                clear_window();
+            } else {
+                adapt();
+            }
+            io->write("boundary", move_to == 0 ? itos(height_boundary)
+                                               : itos(height_boundary) + "," + itos(move_to) + "," + itos(cursor));
+        }
+        if (!lazy.empty() || !dirty.empty()) {
+            compact(lazy_budget < 0 ? boundary : lazy_budget);
+            save_lazy();
+        }
+        flush_levels();
+        return MerkleBase::commit();
     }
 
     std::string gen_proof(const std::string &spos) override {
+        auto start = std::chrono::steady_clock::now();
         std::string s, output;
         Int pos = std::stoi(spos);
         Int id = pos + num_leaf;
-        for (; id >= boundary; id /= 2) {
+        Int b = 1LL << height_at(id);
+        for (; id >= b; id /= 2) {
             io->read(itos(id / 2 * 4 + 1 - id), s);
             output.append(s);
         }
-        get_high(id, output);
+        if (lazy.empty()) {
+            get_high(id, output);
+        } else {
+            std::vector<std::string> self_proofs;
+            read_levels(id, self_proofs);
+            for (const auto &h : self_proofs) {
+                output.append(h);
+            }
+        }
+        if (adapt_window > 0) {
+            ++window_proofs;
+            proof_ns += (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+        }
         return output;
     }
+
+    // Each block is checked as its proofs are: the hash of its subtree, from
+    // the stored nodes, has to climb through its levels to root.
+    bool walk_from(const std::string &root, const Visit &visit, std::vector<std::string> *leaves) override {
+        if (leaves != nullptr) {
+            leaves->assign(num_leaf, "");
+        }
+        std::vector<std::string> self_proofs;
+        std::string l, r, s;
+        for (Int u = 1LL << (unit_height() - 1); u < 1LL << unit_height(); ++u) {
+            // a subtree with its blocks a level below has two of them
+            Int n = height_at(u) > unit_height() ? 2 : 1;
+            for (Int b = u * n; b < u * n + n; ++b) {
+                if ((l = walk_node(b * 2, visit, leaves)).empty() || (r = walk_node(b * 2 + 1, visit, leaves)).empty()
+                        || !walk_block(b, visit)) {
+                    return false;
+                }
+                std::string key = calculateSHA256Hash(l + r);
+                self_proofs.clear();
+                read_levels(b, self_proofs);
+                Int id = b;
+                for (auto &h : self_proofs) {
+                    key = calculateSHA256Hash((id & 1) == 0 ? key.append(h) : h.append(key));
+                    id /= 2;
+                }
+                if (key != root) {
+                    return false;
+                }
+            }
+        }
+        for (const auto &e : lazy) {
+            if (!io->read(lazy_key(e.first), s)) {
+                return false;
+            }
+            visit(lazy_key(e.first), s);
+        }
+        for (const char *key : {"1", "boundary", "lazy"}) {
+            if (io->read(key, s)) {
+                visit(key, s);
+            }
+        }
+        return !root.empty();
+    }
 };
 
 class DupTreeSimple : public DupTree {
+    Int high_reads(Int h) const override {
+        return h - 1;
+    }
+    void remove_block(Int id) override {
+        for (Int i = level_of(id); i > 1; i--) {
+            io->remove(itos(id) + "-" + itos(i));
+        }
+    }
     void modify_id_level(Int id, Int level, const std::string &key) override {
         io->write(itos(id) + "-" + itos(level), key);
     }
     void get_high(Int id, std::string &output) override {
         std::string s;
-        for (Int i = height_boundary; i > 1; i--) {
+        for (Int i = level_of(id); i > 1; i--) {
             io->read(itos(id) + "-" + itos(i), s);
             output.append(s);
         }
     }
     void read_self(Int id, std::vector<std::string> &self_proofs) override {
         std::string s;
-        for (Int i = height_boundary; i > 1; i--) {
+        for (Int i = level_of(id); i > 1; i--) {
             io->read(itos(id) + "-" + itos(i), s);
             self_proofs.push_back(s);
         }
     }
+    bool walk_block(Int id, const Visit &visit) override {
+        std::string s;
+        for (Int i = level_of(id); i > 1; i--) {
+            if (!io->read(itos(id) + "-" + itos(i), s)) {
+                return false;
+            }
+            visit(itos(id) + "-" + itos(i), s);
+        }
+        return true;
+    }
 public:
-    DupTreeSimple(Int height, Int height_boundary) : DupTree(height, height_boundary) {}
+    DupTreeSimple(Int height, Int height_boundary, Int lazy_budget = -1, Int adapt_window = 0)
+            : DupTree(height, height_boundary, lazy_budget, adapt_window) {}
     std::string get_name() override {
         return "duptree_simple";
     }
 };
 
+// Each block id keeps the sibling hashes of the levels from its own down to 2
+// in one record under itos(id), 32 raw bytes per level in proof order. Level patches go into the cached record in place, and a record is
+// written once however many updates touched it, at commit(), when more than
+// max_pending records are cached, or at the end of init().
 class DupTreeBlock : public DupTree {
+    static const Int HASH_BYTES = 32;
+    size_t max_pending;
+    std::unordered_map<Int, std::string> pending;
+
+    static Int record_size(Int id) {
+        return (level_of(id) - 1) * HASH_BYTES;
+    }
+
+    std::string &record(Int id) {
+        auto it = pending.find(id);
+        if (it != pending.end()) {
+            return it->second;
+        }
+        std::string &rec = pending[id];
+        if (!io->read(itos(id), rec) || (Int)rec.length() != record_size(id)) {
+            rec.assign(record_size(id), 0);
+        }
+        return rec;
+    }
+
+    void read_record(Int id, std::string &rec) {
+        auto it = pending.find(id);
+        if (it != pending.end()) {
+            rec = it->second;
+        } else if (!io->read(itos(id), rec) || (Int)rec.length() != record_size(id)) {
+            rec.assign(record_size(id), 0);
+        }
+    }
+
+    Int high_reads(Int) const override {
+        return 1;
+    }
+    void remove_block(Int id) override {
+        pending.erase(id);
+        io->remove(itos(id));
+    }
     void modify_id_level(Int id, Int level, const std::string &key) override {
-        std::string pre;
-        if (!io->read(itos(id), pre) || pre.empty()) {
-            pre = std::string((height_boundary - 1) * 64, '0').replace((level - 2) * 64, 64, key);
-        } else {
-            pre = pre.replace((height_boundary - level) * 64, 64, key);
+        modify_range(id, id, level, key);
+    }
+    void modify_range(Int l, Int r, Int level, const std::string &key) override {
+        std::string bytes = hex_to_bytes(key);
+        Int offset = (level_of(l) - level) * HASH_BYTES;
+        for (Int i = l; i <= r; ++i) {
+            std::memcpy(&record(i)[offset], bytes.data(), HASH_BYTES);
         }
-        io->write(itos(id), pre);
+    }
+    void flush_levels() override {
+        for (const auto &p : pending) {
+            io->write(itos(p.first), p.second);
+        }
+        pending.clear();
     }
     void get_high(Int id, std::string &output) override {
-        std::string s;
-        io->read(itos(id), s);
-        output.append(s);
+        std::string rec;
+        read_record(id, rec);
+        size_t n = output.length();
+        output.resize(n + rec.length() * 2);
+        bytes_to_hex(rec.data(), rec.length(), &output[n]);
     }
     void read_self(Int id, std::vector<std::string> &self_proofs) override {
-        std::string s;
-        io->read(itos(id), s);
-        for (Int i = 0; i < s.length(); i += 64) {
-            self_proofs.push_back(s.substr(i, 64));
+        std::string rec;
+        read_record(id, rec);
+        for (Int i = 0; i < (Int)rec.length(); i += HASH_BYTES) {
+            self_proofs.push_back(bytes_to_hex(rec.data() + i, HASH_BYTES));
         }
     }
+    bool walk_block(Int id, const Visit &visit) override {
+        std::string rec;
+        if (!io->read(itos(id), rec) || (Int)rec.length() != record_size(id)) {
+            return false;
+        }
+        visit(itos(id), rec);
+        return true;
+    }
 public:
-    DupTreeBlock(Int height, Int height_boundary) : DupTree(height, height_boundary) {}
+    DupTreeBlock(Int height, Int height_boundary, Int lazy_budget = -1, Int adapt_window = 0,
+                 size_t max_pending = 1 << 16)
+            : DupTree(height, height_boundary, lazy_budget, adapt_window), max_pending(max_pending) {}
+
+    void update(const std::string &spos, const std::string &value) override {
+        DupTree::update(spos, value);
+        if (pending.size() > max_pending) {
+            flush_levels();
+        }
+    }
+
     std::string get_name() override {
         return "duptree_block";
     }
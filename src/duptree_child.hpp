@@ -109,7 +109,7 @@ public:
 
     bool init(IO *io, bool create_db, std::string *values) override {
         this->io = io;
-        if (!this->io->open()) {
+        if (!this->io->open(create_db)) {
             return false;
         }
         if (create_db) {
@@ -117,11 +117,17 @@ public:
             io->write(itos(boundary / 2), cal.second);
             digest = cal.first.get_hash_val();
             gen_merge(1);
-            this->io->flush();
+            commit();
         } else {
             std::string value;
-            io->read(itos(boundary / 2), value);
-            digest = value.substr(value.length() - 64 * 3, 64);
+            std::vector<Int> counters;
+            if (!nested) {
+                if (!recover(digest, counters)) {
+                    return false;
+                }
+            } else if (io->read(itos(boundary / 2), value) && value.length() >= 64 * 3) {
+                digest = value.substr(value.length() - 64 * 3, 64);
+            }
         }
         return true;
     }
@@ -1,44 +1,118 @@
 #ifndef DUPTREE_DUPTREE_PLUS_HPP
 #define DUPTREE_DUPTREE_PLUS_HPP
 
+#include <map>
+#include <thread>
+#include <atomic>
+#include <functional>
 #include "mem_checker.hpp"
 #include "duptree.hpp"
 
 template <class DUP>
 class DupTreePlus : public MerkleBase {
-    Int base_height{};
+    Int base_height{}, base_height_boundary{};
     Int P, Pl, num_blocks;
     MerkleBase *base_tree[2]{};
     IOMultiple *iom;
 
-    std::string gen_node(Int id, std::string *values) {
-        if (id >= num_blocks) {
-            iom->change_id(id);
-            if (values == nullptr) {
-                std::string vals[Pl];
-                for (Int i = 0; i < Pl; ++i) {
-                    vals[i] = calculateSHA256Hash(random_string());
-                }
-                base_tree[1]->init(iom, true, vals);
-            } else {
-                base_tree[1]->init(iom, true, values + ((id - num_blocks) * Pl));
+    // Own base trees over an own overlay of io, for init() and update_batch().
+    struct Worker {
+        IOOverlay overlay;
+        IOMultiple iom;
+        MerkleBase *tree[2]{};
+        std::mt19937_64 rng;
+
+        explicit Worker(IO *io) : overlay(io), iom(&overlay) {}
+        ~Worker() {
+            if (tree[1] != tree[0]) {
+                delete tree[1];
             }
-            return base_tree[1]->get_digest();
+            delete tree[0];
         }
-        std::string vals[P];
-        for (Int i = 0; i < P; ++i) {
-            vals[i] = gen_node((id - 1) * P + 2 + i, values);
+    };
+    int threads;
+    std::vector<Worker *> workers;
+
+    MerkleBase *new_base(bool leaf) {
+        MerkleBase *tree;
+        if (leaf && height % base_height != 0) {
+            tree = new DUP(height % base_height, std::min(height % base_height, base_height_boundary));
+        } else {
+            tree = new DUP(base_height, base_height_boundary);
         }
-        iom->change_id(id);
-        base_tree[0]->init(iom, true, vals);
-        return base_tree[0]->get_digest();
+        tree->set_nested();
+        return tree;
+    }
+
+    void make_workers() {
+        while (workers.size() < (size_t)threads) {
+            auto *w = new Worker(io);
+            w->tree[0] = new_base(false);
+            w->tree[1] = Pl == P ? w->tree[0] : new_base(true);
+            w->tree[0]->init(&w->iom, false, nullptr);
+            if (w->tree[1] != w->tree[0]) {
+                w->tree[1]->init(&w->iom, false, nullptr);
+            }
+            workers.push_back(w);
+        }
+    }
+
+    // Runs work on the first n workers, on this thread and straight into io if
+    // n is 1.
+    void run_workers(size_t n, const std::function<void(Worker *)> &work) {
+        if (n <= 1) {
+            workers[0]->overlay.apply();
+            workers[0]->overlay.direct = true;
+            work(workers[0]);
+            workers[0]->overlay.direct = false;
+            return;
+        }
+        std::vector<std::thread> pool;
+        for (size_t t = 0; t < n; ++t) {
+            pool.emplace_back(work, workers[t]);
+        }
+        for (auto &t : pool) {
+            t.join();
+        }
+    }
+
+    // Builds block id and its subtree with w; blocks in built are already done.
+    std::string gen_node(Worker *w, Int id, std::string *values, const std::map<Int, std::string> &built) {
+        auto it = built.find(id);
+        if (it != built.end()) {
+            return it->second;
+        }
+        bool leaf = id >= num_blocks;
+        std::vector<std::string> vals;
+        if (!leaf) {
+            vals.resize(P);
+            for (Int i = 0; i < P; ++i) {
+                vals[i] = gen_node(w, (id - 1) * P + 2 + i, values, built);
+            }
+        } else if (values == nullptr) {
+            vals.resize(Pl);
+            for (auto &v : vals) {
+                v = random_digest(w->rng);
+            }
+        }
+        w->iom.change_id(id);
+        w->tree[leaf]->init(&w->iom, true, leaf && values != nullptr ? values + (id - num_blocks) * Pl : vals.data());
+        if (w->overlay.writes.size() >= 1 << 14) {
+            w->overlay.apply();
+        }
+        return w->tree[leaf]->get_digest();
     }
 
 public:
-    DupTreePlus(Int height, Int base_height, Int base_height_boundary) : MerkleBase(height) {
+    DupTreePlus(Int height, Int base_height, Int base_height_boundary, int threads = 0) : MerkleBase(height) {
         this->base_height = base_height;
+        this->base_height_boundary = base_height_boundary;
+        if (threads <= 0) {
+            threads = (int)std::thread::hardware_concurrency();
+        }
+        this->threads = threads < 1 ? 1 : threads;
         P = 1LL << base_height;
-        base_tree[0] = new DUP(base_height, base_height_boundary);
+        base_tree[0] = new_base(false);
         if (height % base_height == 0) {
             Pl = P;
             num_blocks = (num_leaf - P) / (P * (P - 1)) + 1;
@@ -46,23 +120,71 @@ public:
         } else {
             Pl = 1LL << (height % base_height);
             num_blocks = ((1LL << ((height / base_height + 1) * base_height)) - P) / (P * (P - 1)) + 1;
-            base_tree[1] = new DUP(height % base_height, std::min(height % base_height, base_height_boundary));
+            base_tree[1] = new_base(true);
         }
         iom = nullptr;
     }
 
     bool init(IO *io, bool create_db, std::string *values) override {
         this->io = io;
+        delete iom;
         iom = new IOMultiple(io);
-        if (!this->io->open()) {
+        for (auto *w : workers) {
+            delete w;
+        }
+        workers.clear();
+        if (!this->io->open(create_db)) {
             return false;
         }
+        make_workers();
         if (create_db) {
-            digest = gen_node(1, values);
-            this->io->flush();
+            // split off subtrees until every worker has a few, build them in
+            // parallel, then the blocks above them on this thread
+            std::vector<Int> roots{1}, next_roots;
+            while (roots.size() < workers.size() * 4 && roots[0] < num_blocks) {
+                next_roots.clear();
+                for (Int id : roots) {
+                    for (Int i = 0; i < P; ++i) {
+                        next_roots.push_back((id - 1) * P + 2 + i);
+                    }
+                }
+                roots.swap(next_roots);
+            }
+            std::mutex lock;
+            for (auto *w : workers) {
+                w->overlay.shared = &lock;
+            }
+            std::vector<std::string> digests(roots.size());
+            std::map<Int, std::string> built;
+            std::atomic<size_t> next(0);
+            run_workers(std::min(roots.size(), workers.size()), [&](Worker *w) {
+                for (size_t i; (i = next++) < roots.size(); ) {
+                    w->rng.seed(roots[i]);
+                    digests[i] = gen_node(w, roots[i], values, built);
+                }
+                w->overlay.apply();
+            });
+            for (size_t i = 0; i < roots.size(); ++i) {
+                built[roots[i]] = digests[i];
+            }
+            run_workers(1, [&](Worker *w) {
+                digest = gen_node(w, 1, values, built);
+            });
+            for (auto *w : workers) {
+                w->overlay.apply();
+                w->overlay.shared = nullptr;
+            }
+            publish(digest);
         } else {
-            base_tree[0]->init(iom, false, nullptr);
-            digest = base_tree[0]->get_digest();
+            std::vector<Int> counters;
+            if (!recover(digest, counters)) {
+                return false;
+            }
+        }
+        iom->change_id(1);
+        base_tree[0]->init(iom, false, nullptr);
+        if (base_tree[1] != base_tree[0]) {
+            base_tree[1]->init(iom, false, nullptr);
         }
         return true;
     }
@@ -74,6 +196,8 @@ public:
         for (Int id = p + num_blocks; ; pos = pos / (id >= num_blocks ? Pl : P), id = (id - 2) / P + 1) {
             iom->change_id(id);
             base_tree[id >= num_blocks]->update(itos(pos % (id >= num_blocks ? Pl : P)), v);
+            // the base trees are shared by all ids, nothing may stay cached past change_id
+            base_tree[id >= num_blocks]->commit();
             v = base_tree[id >= num_blocks]->get_digest();
             if (id == 1) {
                 break;
@@ -82,6 +206,60 @@ public:
         digest = v;
     }
 
+    // One level of blocks at a time, leaves first. Each touched block takes all
+    // of its updates and then gives its new digest to its parent as a single
+    // update; blocks of a level share nothing, so they run on the workers.
+    void update_batch(const std::vector<std::pair<std::string, std::string>> &updates) override {
+        if (updates.empty()) {
+            return;
+        }
+        // block id -> (position at that block's level, value), in order
+        std::map<Int, std::vector<std::pair<Int, std::string>>> level, parents;
+        for (const auto &u : updates) {
+            Int pos = std::stoi(u.first);
+            level[pos / Pl + num_blocks].emplace_back(pos, u.second);
+        }
+        make_workers();
+        std::vector<std::pair<Int, std::vector<std::pair<Int, std::string>> *>> jobs;
+        std::vector<std::string> digests;
+        for (;;) {
+            jobs.clear();
+            for (auto &b : level) {
+                jobs.emplace_back(b.first, &b.second);
+            }
+            digests.assign(jobs.size(), "");
+            std::atomic<size_t> next(0);
+            auto work = [&](Worker *w) {
+                for (size_t i; (i = next++) < jobs.size(); ) {
+                    Int id = jobs[i].first;
+                    MerkleBase *tree = w->tree[id >= num_blocks];
+                    w->iom.change_id(id);
+                    for (const auto &u : *jobs[i].second) {
+                        tree->update(itos(u.first % (id >= num_blocks ? Pl : P)), u.second);
+                    }
+                    tree->commit();
+                    digests[i] = tree->get_digest();
+                }
+            };
+            size_t n = std::min(jobs.size(), workers.size());
+            run_workers(n, work);
+            for (size_t t = 0; t < n; ++t) {
+                workers[t]->overlay.apply();
+            }
+            if (jobs[0].first == 1) {
+                digest = digests[0];
+                return;
+            }
+            parents.clear();
+            for (size_t i = 0; i < jobs.size(); ++i) {
+                Int id = jobs[i].first;
+                Int pos = jobs[i].second->front().first / (id >= num_blocks ? Pl : P);
+                parents[(id - 2) / P + 1].emplace_back(pos, digests[i]);
+            }
+            level.swap(parents);
+        }
+    }
+
     std::string gen_proof(const std::string &spos) override {
         Int pos = std::stoi(spos);
         std::string output;
@@ -96,11 +274,38 @@ public:
         return output;
     }
 
+    // Blocks top down, each against the digest its parent holds as a leaf.
+    bool walk(const Visit &visit) override {
+        std::vector<std::pair<Int, std::string>> blocks{{1, digest}};
+        std::vector<std::string> leaves;
+        while (!blocks.empty()) {
+            Int id = blocks.back().first;
+            std::string root = blocks.back().second;
+            blocks.pop_back();
+            bool leaf = id >= num_blocks;
+            iom->change_id(id);
+            if (!base_tree[leaf]->walk_from(root, [&](const std::string &k, const std::string &v) {
+                    visit(iom->full_key(k), v);
+                }, leaf ? nullptr : &leaves)) {
+                iom->change_id(1);
+                return false;
+            }
+            for (Int i = 0; !leaf && i < P; ++i) {
+                blocks.emplace_back((id - 1) * P + 2 + i, leaves[i]);
+            }
+        }
+        iom->change_id(1);
+        return visit_root(visit);
+    }
+
     std::string get_name() override {
         return "duptree_plus[" + base_tree[0]->get_name() + "]";
     }
 
     ~DupTreePlus() override {
+        for (auto *w : workers) {
+            delete w;
+        }
         if (base_tree[1] != base_tree[0]) {
             delete base_tree[1];
         }
@@ -2,6 +2,8 @@
 #define DUPTREE_FATTREE_HPP
 
 #include "mem_checker.hpp"
+#include "codec.hpp"
+#include "nibble_path.hpp"
 
 class NodeFat {
 public:
@@ -24,34 +26,20 @@ public:
         io->read(key, v);
         isRoot = key == "*";
         this->key = key;
-        if (v[0] == '!') {
-            isLeaf = true;
-            this->value = v.substr(1);
+        codec::Record rec;
+        codec::decode(v, rec);
+        isLeaf = rec.isLeaf;
+        if (isLeaf) {
+            this->value = rec.value;
         } else {
-            isLeaf = false;
-            Int pos = 0, pred = 0;
-            for (int i = 0; i < 16; ++i) {
-                while (v[pos] != ':')
-                    ++pos;
-                keys.emplace_back(v.substr(pred, pos - pred));
-                pred = pos = pos + 1;
-                while (pos < v.length() && v[pos] != ',')
-                    ++pos;
-                hashes.emplace_back(v.substr(pred, pos - pred));
-                pred = pos = pos + 1;
-            }
+            keys = std::move(rec.keys);
+            hashes = std::move(rec.hashes);
         }
     }
     std::string to_string() {
         if (isLeaf)
-            return "!" + value;
-        std::string output;
-        for (int i = 0; i < 16; ++i) {
-            output.append(keys[i] + ":" + hashes[i]);
-            if (i < 15)
-                output.append(",");
-        }
-        return output;
+            return codec::encode_leaf("", nullptr, value);
+        return codec::encode_branch("", nullptr, &keys, &hashes);
     }
     std::string computeHash() {
         if (isLeaf)
@@ -66,7 +54,10 @@ public:
         io->write(key, to_string());
     }
     int ofWhich(const std::string &k) {
-        return hti[k[isRoot ? 0 : key.length()]];
+        return hex_value(k[isRoot ? 0 : key.length()]);
+    }
+    int ofWhich(const NibblePath &k) {
+        return k.nibble(isRoot ? 0 : key.length());
     }
     bool isPrefixChild(int child, const std::string &k) {
         return is_prefix(k, keys[child]);
@@ -89,21 +80,25 @@ public:
 
     bool init(IO *io, bool create_db, std::string *values) override {
         this->io = io;
-        if (!this->io->open()) {
+        if (!this->io->open(create_db)) {
             return false;
         }
         if (create_db) {
-            this->io->write("*", ":,:,:,:,:,:,:,:,:,:,:,:,:,:,:,:");
-            this->io->flush();
+            this->io->write("*", NodeFat("*", std::vector<std::string>(16), std::vector<std::string>(16)).to_string());
             this->digest = calculateSHA256Hash("");
+            commit();
         } else {
-            //not available
+            std::vector<Int> counters;
+            if (!recover(digest, counters)) {
+                return false;
+            }
         }
         return true;
     }
 
     void update(const std::string &spos, const std::string &value) override {
         std::string hex(spos);
+        NibblePath path(hex);
         NodeFat root("*", io);
         std::vector<NodeFat> stack;
         std::vector<int> lefts;
@@ -114,7 +109,7 @@ public:
         for ( ; ; ) {
 
             NodeFat &cur = stack[stack.size() - 1];
-            int which = cur.ofWhich(hex);
+            int which = cur.ofWhich(path);
             lefts.push_back(which);
             if (++cnt > 42) {
                 throw std::invalid_argument("");
@@ -144,7 +139,7 @@ public:
                     newHashes.emplace_back("");
                 }
                 NodeFat newNode(newKey, newKeys, newHashes);
-                int w1 = newNode.ofWhich(hex);
+                int w1 = newNode.ofWhich(path);
                 newNode.keys[w1] = hex;
                 newNode.hashes[w1] = hashUp;
                 int w2 = newNode.ofWhich(cur.keys[which]);
@@ -168,6 +163,7 @@ public:
 
     std::string gen_proof(const std::string &spos) override {
         std::string hex(spos), tmp;
+        NibblePath path(hex);
         io->read(hex, tmp);
         if (tmp.empty())
             return "?";
@@ -180,7 +176,7 @@ public:
             if (++cnt > 41)
                 throw std::invalid_argument("");
             NodeFat cur(key, io);
-            int which = cur.ofWhich(hex);
+            int which = cur.ofWhich(path);
             //if (cur.isRoot && (isLeft && cur.rightKey.empty() || !isLeft && cur.leftKey.empty())) {
             //} else
             {
@@ -222,12 +218,53 @@ public:
         return key == digest;
     }
 
+    std::pair<Int, Int> commit() override {
+        publish(digest);
+        return {0, 0};
+    }
+
+    // The hash of the node under key after checking every node under it
+    // against the hashes their parents hold, "" if one is missing or does
+    // not match.
+    std::string walk_node(const std::string &key, const Visit &visit, int depth = 0) {
+        std::string v, children;
+        codec::Record rec;
+        if (depth > verifier::MAX_STEPS || !io->read(key, v) || !codec::try_decode(v, rec)) {
+            return "";
+        }
+        visit(key, v);
+        if (rec.isLeaf) {
+            return calculateSHA256Hash(rec.value);
+        }
+        for (int i = 0; i < 16; ++i) {
+            if (rec.keys[i].empty() != rec.hashes[i].empty()
+                    || (!rec.keys[i].empty() && walk_node(rec.keys[i], visit, depth + 1) != rec.hashes[i])) {
+                return "";
+            }
+            children.append(rec.hashes[i]);
+        }
+        return calculateSHA256Hash(children);
+    }
+
+    bool walk(const Visit &visit) override {
+        return walk_node("*", visit) == digest && visit_root(visit);
+    }
+
     std::string get_name() override {
         return "fat_tree";
     }
 
+    std::string get_digest() override {
+        return digest;
+    }
+    verifier::Family proof_family() override {
+        return verifier::HEX;
+    }
+
     ~FatTree() override {
-        io->flush();
+        if (io != nullptr) {
+            io->discard();
+        }
     }
 };
 
@@ -294,7 +331,7 @@ public:
         io->write(key, to_string());
     }
     int ofWhich(const std::string &k) {
-        return hti[k[isRoot ? 0 : key.length()]];
+        return hex_value(k[isRoot ? 0 : key.length()]);
     }
     bool isPrefixChild(int child, const std::string &k) {
         return is_prefix(k, keys[child]);
@@ -455,7 +492,9 @@ public:
     }
 
     ~FatterTree() override {
-        io->flush();
+        if (io != nullptr) {
+            io->discard();
+        }
     }
 };*/
 
@@ -481,27 +520,19 @@ public:
         io->read(key, v);
         isRoot = key == "*";
         this->key = key;
-        if (v[0] == '!') {
-            isLeaf = true;
-            this->value = v.substr(1);
+        codec::Record rec;
+        codec::decode(v, rec);
+        isLeaf = rec.isLeaf;
+        if (isLeaf) {
+            this->value = rec.value;
         } else {
-            isLeaf = false;
-            for (Int i = 0; i < v.length(); i += 64) {
-                hashes.emplace_back(v.substr(i, 64));
-            }
-            while (hashes.size() < 16) {
-                hashes.emplace_back("");
-            }
+            hashes = std::move(rec.hashes);
         }
     }
     std::string to_string() {
         if (isLeaf)
-            return "!" + value;
-        std::string output;
-        for (int i = 0; i < 16; ++i) {
-            output.append(hashes[i]);
-        }
-        return output;
+            return codec::encode_leaf("", nullptr, value);
+        return codec::encode_branch("", nullptr, nullptr, &hashes);
     }
     std::string computeHash() {
         if (isLeaf)
@@ -534,15 +565,19 @@ public:
 
     bool init(IO *io, bool create_db, std::string *values) override {
         this->io = io;
-        if (!this->io->open()) {
+        if (!this->io->open(create_db)) {
             return false;
         }
         if (create_db) {
-            this->io->write("*", "");
-            this->io->flush();
+            this->io->write("*", NodeFatMint("*", std::vector<std::string>(16)).to_string());
             this->digest = calculateSHA256Hash("");
+            commit();
         } else {
-            //not available
+            std::vector<Int> counters;
+            if (!recover(digest, counters)) {
+                return false;
+            }
+            num_leaf = counters[0];
         }
         return true;
     }
@@ -568,7 +603,7 @@ public:
         std::string hashUp;
         for ( ; ; ++p) {
             NodeFatMint &cur = stack[stack.size() - 1];
-            int which = hti[hex[p]];
+            int which = hex_value(hex[p]);
             val = val + ((1ll << (4 * p)) * which);
             if (isNew && val + ((1ll << (4 * p)) * (15 - which)) >= num_leaf - 1 || !isNew && val + (1 << (4 * (p + 1))) >= num_leaf) {
                 NodeFatMint newLeaf(hex, value);
@@ -598,7 +633,7 @@ public:
         }
         for (Int i = stack.size() - 1; i >= 0; --i) {
             NodeFatMint &cur = stack[i];
-            cur.hashes[hti[hex[i]]] = hashUp;
+            cur.hashes[hex_value(hex[i])] = hashUp;
             hashUp = cur.computeHash();
             cur.write(io);
         }
@@ -619,7 +654,7 @@ public:
 
         for ( ; ; ++p) {
             NodeFatMint cur(key, io);
-            int which = hti[hex[p]];
+            int which = hex_value(hex[p]);
             val = val + ((1ll << (4 * p)) * which);
             //if (cur.isRoot && (isLeft && cur.rightKey.empty() || !isLeft && cur.leftKey.empty())) {
             //} else
@@ -662,12 +697,26 @@ public:
         return key == digest;
     }
 
+    std::pair<Int, Int> commit() override {
+        publish(digest, {num_leaf});
+        return {0, 0};
+    }
+
     std::string get_name() override {
         return "fat_mint";
     }
 
+    std::string get_digest() override {
+        return digest;
+    }
+    verifier::Family proof_family() override {
+        return verifier::HEX;
+    }
+
     ~FatMint() override {
-        io->flush();
+        if (io != nullptr) {
+            io->discard();
+        }
     }
 };
 
@@ -0,0 +1,94 @@
+#ifndef DUPTREE_HISTOGRAM_HPP
+#define DUPTREE_HISTOGRAM_HPP
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// Log-linear latency histogram in the style of HdrHistogram: values below
+// 2^SUB_BITS get their own bucket, every larger power of two is split into
+// 2^(SUB_BITS-1) equal buckets, so any recorded value is reported within
+// 1/64 of itself. Values are nanoseconds.
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 7;
+    static const uint64_t SUB_COUNT = 1ULL << SUB_BITS;
+    static const uint64_t HALF = SUB_COUNT / 2;
+    static const size_t BUCKETS = (64 - SUB_BITS + 1) * HALF + HALF;
+
+private:
+    std::vector<uint64_t> counts;
+    uint64_t total = 0, sum = 0, min_value = UINT64_MAX, max_value = 0;
+
+    static size_t index_of(uint64_t v) {
+        if (v < SUB_COUNT)
+            return (size_t)v;
+        int shift = 63 - __builtin_clzll(v) - SUB_BITS + 1;
+        return (size_t)(shift * HALF + (v >> shift));
+    }
+
+    // largest value that lands in bucket i
+    static uint64_t highest_of(size_t i) {
+        if (i < SUB_COUNT)
+            return i;
+        uint64_t shift = i / HALF - 1, sub = i - shift * HALF;
+        return ((sub + 1) << shift) - 1;
+    }
+
+public:
+    LatencyHistogram() : counts(BUCKETS, 0) {}
+
+    void record(uint64_t ns) {
+        ++counts[index_of(ns)];
+        ++total;
+        sum += ns;
+        min_value = std::min(min_value, ns);
+        max_value = std::max(max_value, ns);
+    }
+
+    void merge(const LatencyHistogram &o) {
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            counts[i] += o.counts[i];
+        }
+        total += o.total;
+        sum += o.sum;
+        min_value = std::min(min_value, o.min_value);
+        max_value = std::max(max_value, o.max_value);
+    }
+
+    void reset() {
+        std::fill(counts.begin(), counts.end(), 0);
+        total = sum = max_value = 0;
+        min_value = UINT64_MAX;
+    }
+
+    uint64_t count() const {
+        return total;
+    }
+    uint64_t min() const {
+        return total == 0 ? 0 : min_value;
+    }
+    uint64_t max() const {
+        return max_value;
+    }
+    double mean() const {
+        return total == 0 ? 0 : (double)sum / (double)total;
+    }
+
+    // Value at or below which p percent of the recorded values fall, never above max().
+    uint64_t percentile(double p) const {
+        if (total == 0)
+            return 0;
+        auto rank = (uint64_t)(p / 100.0 * (double)total + 0.5);
+        rank = std::max<uint64_t>(rank, 1);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            seen += counts[i];
+            if (seen >= rank)
+                return std::min(highest_of(i), max_value);
+        }
+        return max_value;
+    }
+};
+
+#endif //DUPTREE_HISTOGRAM_HPP
@@ -2,18 +2,42 @@
 #define DUPTREE_IO_HPP
 
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <functional>
+#include <stdexcept>
 #include <leveldb/db.h>
+#include <memory>
 #include <iostream>
 #include <utility>
 #include "leveldb/write_batch.h"
 #include "tools.hpp"
+#include "profiler.hpp"
 
 class IO {
 public:
-    virtual bool open() = 0;
+    // create starts from an empty store; otherwise what is there is kept.
+    virtual bool open(bool create = true) = 0;
     virtual void write(const std::string &key, const std::string &value) = 0;
+    // Throws std::runtime_error if storage rejects the writes, which are then
+    // kept for the next flush().
     virtual void flush() = 0;
     virtual bool read(const std::string &key, std::string &value) = 0;
+    virtual void remove(const std::string &key) = 0;
+    // Hint that many keys were removed and their space may be reclaimed.
+    virtual void compact() {}
+    // Drops the writes and removes not flushed yet; IOs that write through
+    // have nothing to drop.
+    virtual void discard() {}
+    // From here on writes and removes reach storage only at flush(), all in
+    // one atomic batch, so a crash leaves either all of them or none.
+    virtual void begin() {}
+    // Makes everything flushed so far durable, false if it may not be. Safe
+    // to call from another thread while writes and flushes go on.
+    virtual bool sync() {
+        return true;
+    }
     virtual std::string get_name() = 0;
     virtual void destroy() = 0;
     virtual ~IO() = default;
@@ -27,20 +51,31 @@ protected:
     leveldb::WriteOptions write_options;
     leveldb::ReadOptions read_options;
     leveldb::WriteBatch batch;
+    bool atomic = false; // begin() was called: no flushes but explicit ones
+    bool compact_due = false; // compact() was called, runs after the next flush
 
 
 public:
     Int batch_size;
     std::unordered_map<std::string, std::string> buffer;
+    std::unordered_set<std::string> removed; // deletes queued in batch, ahead of buffer
     explicit IOLevelDB(std::string name, Int batch = 10000, bool write_sync = true) : batch_size(batch), db_name(std::move(name)) {
         write_options.sync = write_sync;
         db = nullptr;
     }
 
-    bool open() override {
+    bool open(bool create = true) override {
+        delete db;
+        db = nullptr;
+        buffer.clear();
+        removed.clear();
+        batch.Clear();
+        atomic = false;
+        compact_due = false;
         leveldb::Options options;
-        options.create_if_missing = true;
-        leveldb::DestroyDB(db_name, options);
+        options.create_if_missing = create;
+        if (create)
+            leveldb::DestroyDB(db_name, options);
         leveldb::Status status = leveldb::DB::Open(options, db_name, &db);
 
         if (!status.ok()) {
@@ -52,35 +87,79 @@ public:
     }
 
     void write(const std::string &key, const std::string &value) override {
+        prof::Scope scope(prof::IO_WRITE);
         buffer[key] = value;
-        if (buffer.size() >= batch_size) {
-            for (const auto& i : buffer)
-                batch.Put(i.first, i.second);
-            db->Write(write_options, &batch);
-            buffer.clear();
-            batch.Clear();
+        if (!atomic && buffer.size() + removed.size() >= batch_size) {
+            flush();
         }
     }
 
     void flush() override {
-        if (buffer.size() >= 0) {
+        prof::Scope scope(prof::IO_WRITE);
+        if (!buffer.empty() || !removed.empty()) {
+            // batch only holds the removes until the write goes through
+            leveldb::WriteBatch out(batch);
             for (const auto& i : buffer)
-                batch.Put(i.first, i.second);
-            db->Write(write_options, &batch);
+                out.Put(i.first, i.second);
+            leveldb::Status status = db->Write(write_options, &out);
+            if (!status.ok()) {
+                throw std::runtime_error("write error: " + db_name + ": " + status.ToString());
+            }
             buffer.clear();
+            removed.clear();
             batch.Clear();
         }
+        if (compact_due) {
+            compact_due = false;
+            db->CompactRange(nullptr, nullptr);
+        }
     }
 
     bool read(const std::string &key, std::string &value) override {
+        prof::Scope scope(prof::IO_READ);
         auto it = buffer.find(key);
         if (it != buffer.end()) {
             value = it->second;
             return true;
         }
+        if (!removed.empty() && removed.count(key) != 0)
+            return false;
         return !db->Get(read_options, key, &value).IsNotFound();
     }
 
+    void remove(const std::string &key) override {
+        prof::Scope scope(prof::IO_WRITE);
+        buffer.erase(key);
+        batch.Delete(key);
+        removed.insert(key);
+        if (!atomic && buffer.size() + removed.size() >= batch_size) {
+            flush();
+        }
+    }
+
+    // Waits for the next flush(): flushing here would split a commit.
+    void compact() override {
+        compact_due = true;
+    }
+
+    void discard() override {
+        buffer.clear();
+        removed.clear();
+        batch.Clear();
+    }
+
+    void begin() override {
+        atomic = true;
+    }
+
+    // A synced write reaches the disk with every write before it.
+    bool sync() override {
+        leveldb::WriteOptions options;
+        options.sync = true;
+        leveldb::WriteBatch empty;
+        return db->Write(options, &empty).ok();
+    }
+
     std::string get_name() override {
         return db_name;
     }
@@ -96,6 +175,122 @@ public:
     }
 };
 
+// Keeps everything in a hash map; for benchmarks that should not pay for LevelDB.
+class IOMemory : public IO {
+    std::string name;
+
+public:
+    std::unordered_map<std::string, std::string> store;
+    explicit IOMemory(std::string name) : name(std::move(name)) {}
+
+    bool open(bool create = true) override {
+        if (create)
+            store.clear();
+        return true;
+    }
+    void write(const std::string &key, const std::string &value) override {
+        prof::Scope scope(prof::IO_WRITE);
+        store[key] = value;
+    }
+    void flush() override {}
+    bool read(const std::string &key, std::string &value) override {
+        prof::Scope scope(prof::IO_READ);
+        auto it = store.find(key);
+        if (it == store.end()) {
+            return false;
+        }
+        value = it->second;
+        return true;
+    }
+    void remove(const std::string &key) override {
+        prof::Scope scope(prof::IO_WRITE);
+        store.erase(key);
+    }
+    std::string get_name() override {
+        return name;
+    }
+
+    void destroy() override {
+        store.clear();
+    }
+
+    ~IOMemory() override = default;
+};
+
+// Holds writes in memory over an IO that is only read meanwhile, so several
+// threads can each work through their own overlay; apply() then hands the
+// writes to the IO underneath from one thread. With shared set, reads that
+// fall through and apply() take that lock instead, so overlays may apply
+// while others still run.
+class IOOverlay : public IO {
+    IO *io;
+
+public:
+    std::unordered_map<std::string, std::string> writes;
+    std::unordered_set<std::string> removes;
+    std::mutex *shared = nullptr;
+    bool direct = false; // sole user of io: write through, nothing to apply
+    explicit IOOverlay(IO *io) : io(io) {}
+
+    bool open(bool create = true) override {
+        return true;
+    }
+    void write(const std::string &key, const std::string &value) override {
+        if (direct) {
+            io->write(key, value);
+            return;
+        }
+        writes[key] = value;
+        removes.erase(key);
+    }
+    void flush() override {}
+    bool read(const std::string &key, std::string &value) override {
+        auto it = writes.find(key);
+        if (it != writes.end()) {
+            value = it->second;
+            return true;
+        }
+        if (removes.count(key) != 0)
+            return false;
+        if (shared != nullptr) {
+            std::lock_guard<std::mutex> guard(*shared);
+            return io->read(key, value);
+        }
+        return io->read(key, value);
+    }
+    void remove(const std::string &key) override {
+        if (direct) {
+            io->remove(key);
+            return;
+        }
+        writes.erase(key);
+        removes.insert(key);
+    }
+
+    void apply() {
+        std::unique_lock<std::mutex> guard;
+        if (shared != nullptr)
+            guard = std::unique_lock<std::mutex>(*shared);
+        for (const auto &key : removes) {
+            io->remove(key);
+        }
+        for (const auto &w : writes) {
+            io->write(w.first, w.second);
+        }
+        writes.clear();
+        removes.clear();
+    }
+
+    std::string get_name() override {
+        return io->get_name();
+    }
+
+    void destroy() override {
+        writes.clear();
+        removes.clear();
+    }
+};
+
 class IOMultiple : public IO {
     std::string identifier;
     IO *io;
@@ -106,17 +301,25 @@ public:
         identifier = itos(id) + "::";
     }
 
-    bool open() override {
+    // Where key under the current id is stored in the underlying io.
+    std::string full_key(const std::string &key) const {
+        return identifier + key;
+    }
+
+    bool open(bool create = true) override {
         return true;
     }
     void write(const std::string &key, const std::string &value) override {
-        io->write(identifier + key, value);
+        io->write(full_key(key), value);
     }
     void flush() override {
         //not sure
     }
     bool read(const std::string &key, std::string &value) override {
-        return io->read(identifier + key, value);
+        return io->read(full_key(key), value);
+    }
+    void remove(const std::string &key) override {
+        io->remove(full_key(key));
     }
 
     std::string get_name() override {
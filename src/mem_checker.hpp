@@ -1,18 +1,88 @@
 #ifndef DUPTREE_MEM_CHECKER_HPP
 #define DUPTREE_MEM_CHECKER_HPP
 
+#include <vector>
 #include "io.hpp"
+#include "verifier.hpp"
 
 class MemChecker {
+public:
+    typedef std::function<void(const std::string &, const std::string &)> Visit;
+
 protected:
     IO *io = nullptr;
+
+    // Ends a commit. The record goes into the same flush as the nodes the
+    // commit wrote, and io holds everything after it back for the next one.
+    // A flush that fails throws out of commit() with nothing published.
+    void publish(const std::string &root, const std::vector<Int> &counters = {}) {
+        std::string s(root);
+        for (Int c : counters) {
+            s.append(",").append(std::to_string(c));
+        }
+        io->write(ROOT_KEY, s);
+        io->flush();
+        io->begin();
+    }
+
+    // The root and counters of the last commit, false if none was published.
+    bool recover(std::string &root, std::vector<Int> &counters) {
+        std::string s;
+        if (!io->read(ROOT_KEY, s)) {
+            return false;
+        }
+        size_t i = s.find(',');
+        root = s.substr(0, i);
+        counters.clear();
+        while (i != std::string::npos) {
+            size_t j = s.find(',', i + 1);
+            counters.push_back(std::stoll(s.substr(i + 1, j == std::string::npos ? j : j - i - 1)));
+            i = j;
+        }
+        return true;
+    }
+
+    // Visits the root record, false if there is none.
+    bool visit_root(const Visit &visit) {
+        std::string s;
+        if (!io->read(ROOT_KEY, s)) {
+            return false;
+        }
+        visit(ROOT_KEY, s);
+        return true;
+    }
+
 public:
+    // The root record: the digest of the last commit and the counters a
+    // checker needs to carry on from it, as "digest,c0,c1,...".
+    static constexpr const char *ROOT_KEY = "#root";
+
     virtual bool init(IO *io, bool create_db, std::string *values) = 0;
     virtual void update(const std::string &spos, const std::string &value) = 0;
+    // Same as update() for each pair in order.
+    virtual void update_batch(const std::vector<std::pair<std::string, std::string>> &updates) {
+        for (const auto &u : updates) {
+            update(u.first, u.second);
+        }
+    }
     virtual std::pair<Int, Int> commit() = 0;
     virtual std::string gen_proof(const std::string &spos) = 0;
     virtual bool verify_proof(const std::string &spos, const std::string &value, const std::string &proof) = 0;
     virtual std::string get_name() = 0;
+    // Root digest, as verifier::verify() takes it.
+    virtual std::string get_digest() = 0;
+    virtual verifier::Family proof_family() = 0;
+    std::string gen_proof_binary(const std::string &spos) {
+        return verifier::encode_proof(proof_family(), gen_proof(spos));
+    }
+    // Calls visit once for each record the root of the last commit reaches
+    // and each record a reopen reads besides, the root record included,
+    // checking on the way that every node hashes to what its parent holds.
+    // False at the first node that is missing or does not match; throws
+    // std::invalid_argument if the checker keeps records no walk finds.
+    virtual bool walk(const Visit &visit) {
+        throw std::invalid_argument(get_name() + " cannot be walked");
+    }
     virtual ~MemChecker() = default;
 };
 
@@ -20,6 +90,35 @@ class MerkleBase : public MemChecker {
 protected:
     std::string digest;
     Int num_leaf, height;
+    // a base tree of a DupTreePlus, which leaves the root record to the outer tree
+    bool nested = false;
+
+    // The hash of an internal node whose record holds up with the hashes of
+    // its children, "" if it does not.
+    virtual std::string node_hash(const std::string &record, const std::string &left, const std::string &right) {
+        std::string h = calculateSHA256Hash(left + right);
+        return record == h ? h : "";
+    }
+
+    // The hash of stored node id after checking every node under it, "" if
+    // one is missing or does not match.
+    std::string walk_node(Int id, const Visit &visit, std::vector<std::string> *leaves) {
+        std::string s, l, r;
+        if (!io->read(itos(id), s)) {
+            return "";
+        }
+        visit(itos(id), s);
+        if (id >= num_leaf) {
+            if (leaves != nullptr) {
+                (*leaves)[id - num_leaf] = s;
+            }
+            return s;
+        }
+        if ((l = walk_node(id * 2, visit, leaves)).empty() || (r = walk_node(id * 2 + 1, visit, leaves)).empty()) {
+            return "";
+        }
+        return node_hash(s, l, r);
+    }
 
     explicit MerkleBase(Int height) {
         this->height = height;
@@ -28,7 +127,23 @@ protected:
     }
 
 public:
-    std::pair<Int, Int> commit() override {}
+    std::pair<Int, Int> commit() override {
+        if (!nested) {
+            publish(digest);
+        }
+        return {0, 0};
+    }
+    void set_nested() {
+        nested = true;
+    }
+    // walk() of the tree under root, without the root record; leaves, if
+    // given, gets the leaf values by position.
+    virtual bool walk_from(const std::string &root, const Visit &visit, std::vector<std::string> *leaves) {
+        throw std::invalid_argument(get_name() + " cannot be walked");
+    }
+    bool walk(const Visit &visit) override {
+        return walk_from(digest, visit, nullptr) && visit_root(visit);
+    }
     bool verify_proof(const std::string &spos, const std::string &value, const std::string &proof) override {
         std::string s, key = value;
         Int pos = std::stoi(spos);
@@ -39,12 +154,18 @@ public:
         return key == digest;
     }
 
-    std::string get_digest() {
+    std::string get_digest() override {
         return digest;
     }
+    verifier::Family proof_family() override {
+        return verifier::MERKLE;
+    }
 
+    // Writes since the last commit never reach storage.
     ~MerkleBase() override {
-        io->flush();
+        if (io != nullptr && !nested) {
+            io->discard();
+        }
     }
 };
 
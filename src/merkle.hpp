@@ -32,15 +32,17 @@ public:
 
     bool init(IO *io, bool create_db, std::string *values) override {
         this->io = io;
-        if (!this->io->open()) {
+        if (!this->io->open(create_db)) {
             return false;
         }
         if (create_db) {
             digest = gen_node(1, values).get_hash_val();
-            this->io->flush();
+            publish(digest);
         } else {
-            io->read("1", digest);
-            digest = N(digest).get_hash_val();
+            std::vector<Int> counters;
+            if (!recover(digest, counters)) {
+                return false;
+            }
         }
         return true;
     }
@@ -64,6 +66,13 @@ public:
         }
         return output;
     }
+
+    bool walk_from(const std::string &root, const Visit &visit, std::vector<std::string> *leaves) override {
+        if (leaves != nullptr) {
+            leaves->assign(num_leaf, "");
+        }
+        return !root.empty() && walk_node(1, visit, leaves) == root;
+    }
 };
 
 class MerkleSimple : public MerkleTree<Node> {
@@ -95,6 +104,10 @@ class MerkleChild : public MerkleTree<NodeChild> {
         key = calculateSHA256Hash(s);
         io->write(itos(id / 2), key + s);
     }
+    std::string node_hash(const std::string &record, const std::string &left, const std::string &right) override {
+        std::string h = calculateSHA256Hash(left + right);
+        return record == h + left + right ? h : "";
+    }
 public:
     explicit MerkleChild(Int height) : MerkleTree<NodeChild>(height) {}
     std::string get_name() override {
@@ -0,0 +1,295 @@
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <random>
+#include "tools.hpp"
+#include "io.hpp"
+#include "rattree.hpp"
+#include "fattree.hpp"
+#include "bench.hpp"
+#include "verifier.hpp"
+
+// Per-primitive benchmarks, built as duptree_micro when Google Benchmark is found.
+// Checker benchmarks run against IOMemory so they measure the tree code alone;
+// BM_IOLevelDB* cover the storage side.
+
+namespace {
+    std::mt19937_64 rng(42);
+
+    std::string random_hex(size_t n) {
+        static const char digits[] = "0123456789ABCDEF";
+        std::string s(n, '0');
+        for (char &c : s) {
+            c = digits[rng() & 15];
+        }
+        return s;
+    }
+
+    std::vector<std::string> random_digests(size_t n) {
+        std::vector<std::string> out(16);
+        for (size_t i = 0; i < n && i < 16; ++i) {
+            out[i] = calculateSHA256Hash(std::to_string(rng()));
+        }
+        return out;
+    }
+
+    const char *LEVELDB_NAME = "micro_bench_db";
+}
+
+static void BM_SHA256(benchmark::State &state) {
+    std::string data(state.range(0), 'a');
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(calculateSHA256Hash(data));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SHA256)->Arg(64)->Arg(128)->Arg(1024);
+
+static void BM_SHA256x8(benchmark::State &state) {
+    std::string data(state.range(0), 'a');
+    const char *lanes[8];
+    for (auto &lane : lanes) {
+        lane = data.data();
+    }
+    unsigned char out[32 * 8];
+    for (auto _ : state) {
+        sha256_x8(lanes, data.length(), out);
+        benchmark::DoNotOptimize(out);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0) * 8);
+}
+BENCHMARK(BM_SHA256x8)->Arg(64)->Arg(128)->Arg(1024);
+
+static void BM_HexToBytes(benchmark::State &state) {
+    std::string hex = random_hex(state.range(0) * 2);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(hex_to_bytes(hex));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_HexToBytes)->Arg(20)->Arg(32)->Arg(1024);
+
+static void BM_BytesToHex(benchmark::State &state) {
+    std::string bytes = hex_to_bytes(random_hex(state.range(0) * 2));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(bytes_to_hex(bytes.data(), bytes.length()));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BytesToHex)->Arg(20)->Arg(32)->Arg(1024);
+
+static void BM_HexToBinary(benchmark::State &state) {
+    std::string hex = random_hex(40);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(hex_to_binary(hex));
+    }
+}
+BENCHMARK(BM_HexToBinary);
+
+static void BM_Itos(benchmark::State &state) {
+    Int i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(itos(i++));
+    }
+}
+BENCHMARK(BM_Itos);
+
+// Arg 0 is a leaf, otherwise a branch with that many children.
+static void BM_NodeRatEncode(benchmark::State &state) {
+    NibblePath path(random_hex(8));
+    NodeRat node = state.range(0) == 0 ? NodeRat("", path, random_hex(120))
+                                       : NodeRat("", path, random_digests(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(node.to_string());
+    }
+}
+BENCHMARK(BM_NodeRatEncode)->Arg(0)->Arg(2)->Arg(16);
+
+static void BM_NodeRatDecode(benchmark::State &state) {
+    NibblePath path(random_hex(8));
+    NodeRat node = state.range(0) == 0 ? NodeRat("k", path, random_hex(120))
+                                       : NodeRat("k", path, random_digests(state.range(0)));
+    IOMemory io("micro");
+    io.write("k", node.to_string());
+    Int num = 0;
+    for (auto _ : state) {
+        NodeRat n("k", &io, num);
+        benchmark::DoNotOptimize(n.hashes.data());
+    }
+}
+BENCHMARK(BM_NodeRatDecode)->Arg(0)->Arg(2)->Arg(16);
+
+static void BM_NodeFatEncode(benchmark::State &state) {
+    std::vector<std::string> keys(16);
+    for (int i = 0; i < state.range(0); ++i) {
+        keys[i] = random_hex(8);
+    }
+    NodeFat node = state.range(0) == 0 ? NodeFat("", random_hex(120))
+                                       : NodeFat("", keys, random_digests(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(node.to_string());
+    }
+}
+BENCHMARK(BM_NodeFatEncode)->Arg(0)->Arg(2)->Arg(16);
+
+static void BM_NodeFatDecode(benchmark::State &state) {
+    std::vector<std::string> keys(16);
+    for (int i = 0; i < state.range(0); ++i) {
+        keys[i] = random_hex(8);
+    }
+    NodeFat node = state.range(0) == 0 ? NodeFat("k", random_hex(120))
+                                       : NodeFat("k", keys, random_digests(state.range(0)));
+    IOMemory io("micro");
+    io.write("k", node.to_string());
+    for (auto _ : state) {
+        NodeFat n("k", &io);
+        benchmark::DoNotOptimize(n.hashes.data());
+    }
+}
+BENCHMARK(BM_NodeFatDecode)->Arg(0)->Arg(2)->Arg(16);
+
+static void BM_IOLevelDBWrite(benchmark::State &state) {
+    IOLevelDB io(LEVELDB_NAME, state.range(0), false);
+    io.open();
+    std::string value = random_hex(128);
+    Int i = 0;
+    for (auto _ : state) {
+        io.write(itos(i++), value);
+    }
+    io.destroy();
+}
+BENCHMARK(BM_IOLevelDBWrite)->Arg(1000)->Arg(10000);
+
+static void BM_IOLevelDBRead(benchmark::State &state) {
+    IOLevelDB io(LEVELDB_NAME, 10000, false);
+    io.open();
+    std::string value = random_hex(128);
+    for (Int i = 0; i < state.range(0); ++i) {
+        io.write(itos(i), value);
+    }
+    io.flush();
+    std::string v;
+    for (auto _ : state) {
+        io.read(itos((Int)(rng() % state.range(0))), v);
+        benchmark::DoNotOptimize(v.data());
+    }
+    io.destroy();
+}
+BENCHMARK(BM_IOLevelDBRead)->Arg(1 << 12)->Arg(1 << 18);
+
+// Cost of flushing a buffer of range(0) pending writes.
+static void BM_IOLevelDBFlush(benchmark::State &state) {
+    IOLevelDB io(LEVELDB_NAME, 1LL << 40, false);
+    io.open();
+    std::string value = random_hex(128);
+    Int next = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (Int i = 0; i < state.range(0); ++i) {
+            io.write(itos(next++), value);
+        }
+        state.ResumeTiming();
+        io.flush();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    io.destroy();
+}
+BENCHMARK(BM_IOLevelDBFlush)->Arg(100)->Arg(10000);
+
+enum CheckerOp {
+    UPDATE,
+    GEN_PROOF,
+    VERIFY, // MemChecker::verify_proof on the hex proof
+    VERIFY_BINARY, // verifier::verify on the binary proof
+    VERIFY_BATCH, // verifier::verify_batch on all binary proofs, one thread
+};
+
+// Single-op update (followed by commit), gen_proof or proof check of one
+// checker. For position-keyed trees the arg is the tree height; hex-keyed
+// trees run at height 40 and the arg is log2 of the number of keys loaded
+// beforehand. Verify benchmarks report the mean proof size as proof_bytes;
+// a VERIFY_BATCH iteration checks all 4096 proofs.
+static void BM_Checker(benchmark::State &state, const CheckerEntry *entry, CheckerOp op) {
+    BenchConfig config;
+    config.height = entry->hex_keys ? 40 : state.range(0);
+    IOMemory io("micro");
+    std::unique_ptr<MemChecker> checker(entry->make(config));
+    if (!checker->init(&io, true, nullptr)) {
+        state.SkipWithError("init failed");
+        return;
+    }
+
+    std::vector<std::string> keys(4096);
+    std::string value = calculateSHA256Hash("value");
+    if (entry->hex_keys) {
+        Int n = 1LL << state.range(0);
+        for (Int i = 0; i < n; ++i) {
+            std::string key = random_hex(40);
+            checker->update(key, value);
+            if ((i + 1) % 1000 == 0)
+                checker->commit();
+            keys[i % keys.size()] = key;
+        }
+        checker->commit();
+        if (n < (Int)keys.size())
+            keys.resize(n);
+    } else {
+        for (auto &key : keys) {
+            key = itos((Int)(rng() % (1ULL << config.height)));
+            if (op >= VERIFY)
+                checker->update(key, value);
+        }
+        checker->commit();
+    }
+
+    std::vector<std::string> proofs;
+    double proof_bytes = 0;
+    if (op >= VERIFY) {
+        for (const auto &key : keys) {
+            proofs.push_back(op == VERIFY ? checker->gen_proof(key) : checker->gen_proof_binary(key));
+            proof_bytes += (double)proofs.back().length();
+        }
+        state.counters["proof_bytes"] = proof_bytes / (double)proofs.size();
+    }
+    std::string root = checker->get_digest();
+    std::vector<std::string> values(keys.size(), value);
+
+    size_t i = 0;
+    for (auto _ : state) {
+        size_t k = i++ % keys.size();
+        const std::string &key = keys[k];
+        if (op == UPDATE) {
+            checker->update(key, value);
+            checker->commit();
+        } else if (op == GEN_PROOF) {
+            benchmark::DoNotOptimize(checker->gen_proof(key));
+        } else if (op == VERIFY) {
+            benchmark::DoNotOptimize(checker->verify_proof(key, value, proofs[k]));
+        } else if (op == VERIFY_BINARY) {
+            benchmark::DoNotOptimize(verifier::verify(root, key, value, proofs[k]));
+        } else {
+            benchmark::DoNotOptimize(verifier::verify_batch(root, keys, values, proofs, 1));
+        }
+    }
+    if (op == VERIFY_BATCH)
+        state.SetItemsProcessed(state.iterations() * (int64_t)proofs.size());
+}
+
+int main(int argc, char **argv) {
+    for (const auto &entry : checker_registry()) {
+        for (CheckerOp op : {UPDATE, GEN_PROOF, VERIFY, VERIFY_BINARY, VERIFY_BATCH}) {
+            const char *prefix[] = {"BM_Update/", "BM_GenProof/", "BM_Verify/", "BM_VerifyBinary/", "BM_VerifyBatch/"};
+            std::string name = prefix[op] + entry.name;
+            auto *b = benchmark::RegisterBenchmark(name.c_str(), BM_Checker, &entry, op);
+            if (entry.hex_keys)
+                b->Arg(10)->Arg(14);
+            else
+                b->Arg(8)->Arg(12)->Arg(16);
+        }
+    }
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
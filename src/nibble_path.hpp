@@ -0,0 +1,115 @@
+#ifndef DUPTREE_NIBBLE_PATH_HPP
+#define DUPTREE_NIBBLE_PATH_HPP
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include "tools.hpp"
+
+// A hex path packed two nibbles per byte, most significant nibble first.
+// Nibbles past size() are always zero, so equal paths have equal bytes.
+class NibblePath {
+public:
+    static const int MAX_NIBBLES = 64;
+
+private:
+    unsigned char bytes[MAX_NIBBLES / 2]{};
+    int len = 0;
+
+    uint64_t word(int w) const {
+        uint64_t v;
+        std::memcpy(&v, bytes + w * 8, 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        v = __builtin_bswap64(v);
+#endif
+        return v;
+    }
+
+public:
+    NibblePath() = default;
+
+    explicit NibblePath(const std::string &hex) {
+        if (hex.length() > MAX_NIBBLES)
+            throw std::invalid_argument("path too long");
+        len = (int)hex.length();
+        for (int i = 0; i < len; ++i) {
+            bytes[i >> 1] |= (unsigned char)(hex_value(hex[i]) << ((i & 1) ? 0 : 4));
+        }
+    }
+
+    int size() const {
+        return len;
+    }
+
+    bool empty() const {
+        return len == 0;
+    }
+
+    int nibble(int i) const {
+        return (bytes[i >> 1] >> ((i & 1) ? 0 : 4)) & 15;
+    }
+
+    // Number of leading nibbles shared with o, compared 16 nibbles at a time.
+    int common_prefix(const NibblePath &o) const {
+        int n = len < o.len ? len : o.len;
+        for (int w = 0; w * 16 < n; ++w) {
+            uint64_t x = word(w) ^ o.word(w);
+            if (x != 0) {
+                int c = w * 16 + (__builtin_clzll(x) >> 2);
+                return c < n ? c : n;
+            }
+        }
+        return n;
+    }
+
+    bool starts_with(const NibblePath &pre) const {
+        return pre.len <= len && common_prefix(pre) == pre.len;
+    }
+
+    NibblePath prefix(int n) const {
+        NibblePath p;
+        p.len = n;
+        std::memcpy(p.bytes, bytes, (n + 1) / 2);
+        if (n & 1)
+            p.bytes[n >> 1] &= 0xf0;
+        return p;
+    }
+
+    bool operator==(const NibblePath &o) const {
+        return len == o.len && std::memcmp(bytes, o.bytes, (len + 1) / 2) == 0;
+    }
+
+    bool operator!=(const NibblePath &o) const {
+        return !(*this == o);
+    }
+
+    std::string to_hex() const {
+        static const char digits[] = "0123456789ABCDEF";
+        std::string hex(len, '0');
+        for (int i = 0; i < len; ++i) {
+            hex[i] = digits[nibble(i)];
+        }
+        return hex;
+    }
+
+    // [nibble count][packed nibbles], as stored in node records.
+    std::string encode() const {
+        std::string out(1, char(len));
+        out.append((const char *)bytes, (len + 1) / 2);
+        return out;
+    }
+
+    static NibblePath decode(const std::string &in) {
+        NibblePath p;
+        if (in.empty())
+            return p;
+        p.len = (unsigned char)in[0];
+        if (p.len > MAX_NIBBLES || (int)in.length() != 1 + (p.len + 1) / 2)
+            throw std::invalid_argument("invalid packed path");
+        std::memcpy(p.bytes, in.data() + 1, (p.len + 1) / 2);
+        return p;
+    }
+};
+
+#endif //DUPTREE_NIBBLE_PATH_HPP
@@ -0,0 +1,162 @@
+#include "profiler.hpp"
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+namespace prof {
+    bool active = false;
+
+    namespace {
+        const char *NAMES[NUM_PHASES] = {"hash", "decode", "encode", "io_read", "io_write", "walk"};
+        const uint64_t EVENTS[NUM_COUNTERS - 1] = {
+                PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+
+        struct Totals {
+            uint64_t calls = 0;
+            uint64_t v[NUM_COUNTERS]{};
+        };
+
+        struct ThreadState;
+        std::mutex registry_mutex;
+        std::vector<ThreadState *> registry;
+        Totals retired[NUM_PHASES]; // from threads that have exited
+
+        struct ThreadState {
+            int fds[NUM_COUNTERS - 1]{-1, -1, -1};
+            bool tried = false;
+            Frame *top = nullptr;
+            Totals totals[NUM_PHASES];
+
+            ThreadState() {
+                std::lock_guard<std::mutex> lock(registry_mutex);
+                registry.push_back(this);
+            }
+
+            ~ThreadState() {
+                std::lock_guard<std::mutex> lock(registry_mutex);
+                for (int p = 0; p < NUM_PHASES; ++p) {
+                    retired[p].calls += totals[p].calls;
+                    for (int c = 0; c < NUM_COUNTERS; ++c) {
+                        retired[p].v[c] += totals[p].v[c];
+                    }
+                }
+                registry.erase(std::find(registry.begin(), registry.end(), this));
+                for (int fd : fds) {
+                    if (fd >= 0)
+                        close(fd);
+                }
+            }
+
+            // cycles leads a group so one read() returns all three counters
+            void open_counters() {
+                tried = true;
+                for (int i = 0; i < NUM_COUNTERS - 1; ++i) {
+                    perf_event_attr attr{};
+                    attr.size = sizeof(attr);
+                    attr.type = PERF_TYPE_HARDWARE;
+                    attr.config = EVENTS[i];
+                    attr.exclude_kernel = 1;
+                    attr.exclude_hv = 1;
+                    attr.read_format = PERF_FORMAT_GROUP;
+                    fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+                    if (fds[i] < 0) {
+                        for (int j = 0; j < i; ++j) {
+                            close(fds[j]);
+                            fds[j] = -1;
+                        }
+                        return;
+                    }
+                }
+            }
+
+            void read_counters(uint64_t out[NUM_COUNTERS]) const {
+                out[0] = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count();
+                struct {
+                    uint64_t nr;
+                    uint64_t values[NUM_COUNTERS - 1];
+                } buf{};
+                if (fds[0] >= 0 && read(fds[0], &buf, sizeof(buf)) == (ssize_t)sizeof(buf)) {
+                    for (int c = 1; c < NUM_COUNTERS; ++c) {
+                        out[c] = buf.values[c - 1];
+                    }
+                } else {
+                    std::fill(out + 1, out + NUM_COUNTERS, 0);
+                }
+            }
+        };
+
+        thread_local ThreadState state;
+    }
+
+    void begin(Phase phase, Frame &frame) {
+        if (!state.tried)
+            state.open_counters();
+        frame.phase = phase;
+        std::fill(frame.inner, frame.inner + NUM_COUNTERS, 0);
+        frame.parent = state.top;
+        state.top = &frame;
+        state.read_counters(frame.start);
+    }
+
+    void end(Frame &frame) {
+        uint64_t now[NUM_COUNTERS];
+        state.read_counters(now);
+        Totals &t = state.totals[frame.phase];
+        ++t.calls;
+        for (int c = 0; c < NUM_COUNTERS; ++c) {
+            uint64_t delta = now[c] - frame.start[c];
+            t.v[c] += delta > frame.inner[c] ? delta - frame.inner[c] : 0;
+            if (frame.parent != nullptr)
+                frame.parent->inner[c] += delta;
+        }
+        state.top = frame.parent;
+    }
+
+    void enable(bool on) {
+        active = on;
+    }
+
+    bool hardware_counters() {
+        if (!state.tried)
+            state.open_counters();
+        return state.fds[0] >= 0;
+    }
+
+    std::vector<PhaseStats> report() {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        std::vector<PhaseStats> out(NUM_PHASES);
+        for (int p = 0; p < NUM_PHASES; ++p) {
+            Totals sum = retired[p];
+            for (const auto *ts : registry) {
+                sum.calls += ts->totals[p].calls;
+                for (int c = 0; c < NUM_COUNTERS; ++c) {
+                    sum.v[c] += ts->totals[p].v[c];
+                }
+            }
+            out[p].name = NAMES[p];
+            out[p].calls = sum.calls;
+            out[p].ns = sum.v[0];
+            out[p].cycles = sum.v[1];
+            out[p].instructions = sum.v[2];
+            out[p].cache_misses = sum.v[3];
+        }
+        return out;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (auto &t : retired) {
+            t = Totals();
+        }
+        for (auto *ts : registry) {
+            for (auto &t : ts->totals) {
+                t = Totals();
+            }
+        }
+    }
+}
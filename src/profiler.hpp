@@ -0,0 +1,69 @@
+#ifndef DUPTREE_PROFILER_HPP
+#define DUPTREE_PROFILER_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Opt-in per-phase CPU counters. Scopes nest; each phase is charged only for
+// the time not spent in inner scopes, so the phases add up to the profiled
+// total. With prof::enable() every thread opens cycles, instructions and
+// cache-miss counters through perf_event_open on its first scope; where that
+// is not permitted only calls and wall time are recorded. Disabled scopes cost
+// one branch.
+namespace prof {
+    enum Phase {
+        HASH,
+        DECODE,
+        ENCODE,
+        IO_READ,
+        IO_WRITE,
+        WALK,
+        NUM_PHASES
+    };
+
+    const int NUM_COUNTERS = 4; // ns, cycles, instructions, cache misses
+
+    struct Frame {
+        Phase phase;
+        uint64_t start[NUM_COUNTERS];
+        uint64_t inner[NUM_COUNTERS];
+        Frame *parent;
+    };
+
+    extern bool active;
+
+    void begin(Phase phase, Frame &frame);
+    void end(Frame &frame);
+
+    class Scope {
+        Frame frame;
+        bool on;
+
+    public:
+        explicit Scope(Phase phase) : on(active) {
+            if (on)
+                begin(phase, frame);
+        }
+        ~Scope() {
+            if (on)
+                end(frame);
+        }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    };
+
+    struct PhaseStats {
+        std::string name;
+        uint64_t calls = 0, ns = 0, cycles = 0, instructions = 0, cache_misses = 0;
+    };
+
+    void enable(bool on = true);
+    // True if the calling thread has hardware counters open.
+    bool hardware_counters();
+    // Totals over all threads, one entry per phase.
+    std::vector<PhaseStats> report();
+    void reset();
+}
+
+#endif //DUPTREE_PROFILER_HPP
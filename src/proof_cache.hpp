@@ -0,0 +1,147 @@
+#ifndef DUPTREE_PROOF_CACHE_HPP
+#define DUPTREE_PROOF_CACHE_HPP
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include "mem_checker.hpp"
+
+// Proofs by key, valid for one root digest. Any change of the digest (a
+// commit, or an update in the trees that hash eagerly) makes every cached
+// proof stale, since the siblings near the root change with it; a lookup
+// under a new digest drops the lot. Least recently used proofs are evicted
+// past capacity bytes.
+class ProofCache {
+public:
+    struct Stats {
+        Int hits = 0, misses = 0, evictions = 0, invalidations = 0;
+        size_t bytes = 0, entries = 0;
+
+        double hit_rate() const {
+            return hits + misses == 0 ? 0 : (double)hits / (double)(hits + misses);
+        }
+    };
+
+private:
+    // per entry, beyond the key and proof bytes
+    static const size_t OVERHEAD = 64;
+
+    using Entry = std::pair<std::string, std::string>; // key, proof
+    std::list<Entry> lru; // most recent first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    std::string digest;
+    size_t capacity;
+    Stats stats;
+
+    static size_t size_of(const Entry &e) {
+        return e.first.length() + e.second.length() + OVERHEAD;
+    }
+
+    void check_digest(const std::string &d) {
+        if (d == digest)
+            return;
+        if (!index.empty())
+            ++stats.invalidations;
+        clear();
+        digest = d;
+    }
+
+public:
+    explicit ProofCache(size_t capacity) : capacity(capacity) {}
+
+    // True and the proof of key if it was cached under digest d.
+    bool get(const std::string &d, const std::string &key, std::string &proof) {
+        check_digest(d);
+        auto it = index.find(key);
+        if (it == index.end()) {
+            ++stats.misses;
+            return false;
+        }
+        ++stats.hits;
+        lru.splice(lru.begin(), lru, it->second);
+        proof = it->second->second;
+        return true;
+    }
+
+    void put(const std::string &d, const std::string &key, const std::string &proof) {
+        check_digest(d);
+        Entry e(key, proof);
+        size_t size = size_of(e);
+        if (size > capacity || index.count(key) != 0)
+            return;
+        while (stats.bytes + size > capacity) {
+            stats.bytes -= size_of(lru.back());
+            index.erase(lru.back().first);
+            lru.pop_back();
+            ++stats.evictions;
+        }
+        lru.push_front(std::move(e));
+        index[key] = lru.begin();
+        stats.bytes += size;
+        stats.entries = index.size();
+    }
+
+    void clear() {
+        lru.clear();
+        index.clear();
+        stats.bytes = 0;
+        stats.entries = 0;
+    }
+
+    const Stats &get_stats() const {
+        return stats;
+    }
+};
+
+// Wraps a checker and answers gen_proof from a ProofCache while the root
+// digest stays the same, e.g. the repeated reads of hot keys within a block.
+class CachedChecker : public MemChecker {
+    std::unique_ptr<MemChecker> inner;
+    ProofCache cache;
+
+public:
+    CachedChecker(MemChecker *inner, size_t capacity) : inner(inner), cache(capacity) {}
+
+    bool init(IO *io, bool create_db, std::string *values) override {
+        cache.clear();
+        return inner->init(io, create_db, values);
+    }
+    void update(const std::string &spos, const std::string &value) override {
+        inner->update(spos, value);
+    }
+    void update_batch(const std::vector<std::pair<std::string, std::string>> &updates) override {
+        inner->update_batch(updates);
+    }
+    std::pair<Int, Int> commit() override {
+        return inner->commit();
+    }
+    std::string gen_proof(const std::string &spos) override {
+        std::string d = inner->get_digest(), proof;
+        if (!cache.get(d, spos, proof)) {
+            proof = inner->gen_proof(spos);
+            cache.put(d, spos, proof);
+        }
+        return proof;
+    }
+    bool verify_proof(const std::string &spos, const std::string &value, const std::string &proof) override {
+        return inner->verify_proof(spos, value, proof);
+    }
+    std::string get_name() override {
+        return inner->get_name();
+    }
+    std::string get_digest() override {
+        return inner->get_digest();
+    }
+    verifier::Family proof_family() override {
+        return inner->proof_family();
+    }
+    bool walk(const Visit &visit) override {
+        return inner->walk(visit);
+    }
+
+    const ProofCache::Stats &cache_stats() const {
+        return cache.get_stats();
+    }
+};
+
+#endif //DUPTREE_PROOF_CACHE_HPP
@@ -1,23 +1,29 @@
 #ifndef DUPTREE_RATTREE_HPP
 #define DUPTREE_RATTREE_HPP
 
+#include <deque>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
 #include "mem_checker.hpp"
+#include "codec.hpp"
+#include "nibble_path.hpp"
 
 class NodeRat {
 public:
     std::string hash, value;
     std::vector<std::string> hashes;
     std::vector<Int> pointers; // used only when hashes[i] == '$'
-    std::string prefix;
+    NibblePath prefix;
     bool isRoot, isLeaf;
-    explicit NodeRat(const std::string &key, const std::string &p, const std::string &value) : pointers(16, -1) {
+    explicit NodeRat(const std::string &key, const NibblePath &p, const std::string &value) : pointers(16, -1) {
         isLeaf = true;
         isRoot = false;
         this->hash = key;
         this->prefix = p;
         this->value = value;
     }
-    explicit NodeRat(const std::string &key, const std::string &p, const std::vector<std::string> &hs) : hashes(hs), pointers(16, -1) {
+    explicit NodeRat(const std::string &key, const NibblePath &p, const std::vector<std::string> &hs) : hashes(hs), pointers(16, -1) {
         isLeaf = false;
         isRoot = false;
         this->hash = key;
@@ -28,37 +34,21 @@ public:
         io->read(key, v);
         num += v.length();
         this->hash = key;
-        auto p = v.find('|');
-        prefix = v.substr(0, p);
-        v = v.substr(p + 1);
+        codec::Record rec;
+        codec::decode(v, rec);
+        prefix = NibblePath::decode(rec.prefix);
         isRoot = prefix.empty();
-        if (v[0] == '!') {
-            isLeaf = true;
-            this->value = v.substr(1);
+        isLeaf = rec.isLeaf;
+        if (isLeaf) {
+            this->value = rec.value;
         } else {
-            isLeaf = false;
-
-            Int pos = 0, pred = 0;
-            for (int i = 0; i < 16; ++i) {
-                while (pos < v.length() && v[pos] != ',')
-                    ++pos;
-                hashes.emplace_back(v.substr(pred, pos - pred));
-                pred = pos = pos + 1;
-            }
-
+            hashes = std::move(rec.hashes);
         }
     }
     std::string to_string() {
         if (isLeaf)
-            return prefix + "|!" + value;
-        std::string output(prefix);
-        output.append("|");
-        for (int i = 0; i < 16; ++i) {
-            output.append(hashes[i]);
-            if (i < 15)
-                output.append(",");
-        }
-        return output;
+            return codec::encode_leaf(prefix.encode(), nullptr, value);
+        return codec::encode_branch(prefix.encode(), nullptr, nullptr, &hashes);
     }
     std::string computeHash() {
         if (isLeaf)
@@ -74,8 +64,8 @@ public:
         num += tmp.length();
         io->write(hash, tmp);
     }
-    int ofWhich(const std::string &k) {
-        return hti[k[prefix.length()]];
+    int ofWhich(const NibblePath &k) {
+        return k.nibble(prefix.size());
     }
 };
 
@@ -110,15 +100,18 @@ public:
 
     bool init(IO *io, bool create_db, std::string *values) override {
         this->io = io;
-        if (!this->io->open()) {
+        if (!this->io->open(create_db)) {
             return false;
         }
         if (create_db) {
             this->digest = calculateSHA256Hash("");
-            this->io->write(this->digest, "|,,,,,,,,,,,,,,,");
-            this->io->flush();
+            this->io->write(this->digest, NodeRat(this->digest, NibblePath(), std::vector<std::string>(16)).to_string());
+            publish(digest);
         } else {
-            //not available
+            std::vector<Int> counters;
+            if (!recover(digest, counters)) {
+                return false;
+            }
         }
         return true;
     }
@@ -132,7 +125,8 @@ public:
         std::vector<NodeRat> stack;
         stack.emplace_back(this->digest, io, num_read);
         for (const auto& pair : list) {
-            std::string hex(pair.first), value(pair.second);
+            NibblePath path(pair.first);
+            const std::string &value = pair.second;
 
             int cnt = 0;
             Int pos = 0;
@@ -141,26 +135,26 @@ public:
                     throw std::invalid_argument("invalid loop");
                 }
                 NodeRat &cur = stack[pos];
-                int which = cur.ofWhich(hex);
+                int which = cur.ofWhich(path);
 
                 if (cur.pointers[which] != -1) {
                     NodeRat &next = stack[cur.pointers[which]];
-                    if (next.prefix == hex) {
+                    if (next.prefix == path) {
                         next.value = value;
                         break;
                     }
-                    if (!is_prefix(hex, next.prefix)) {
-                        std::string np(next.prefix);
-                        stack.emplace_back("", hex, value);
+                    if (!path.starts_with(next.prefix)) {
+                        NibblePath np(next.prefix);
+                        stack.emplace_back("", path, value);
 
-                        std::string newPrefix = common_prefix(hex, np);
+                        NibblePath newPrefix = path.prefix(path.common_prefix(np));
                         std::vector<std::string> newHashes;
                         for (int i = 0; i < 16; ++i) {
                             newHashes.emplace_back("");
                         }
                         stack.emplace_back("", newPrefix, newHashes);
                         NodeRat &newNode = stack[stack.size() - 1];
-                        int w1 = newNode.ofWhich(hex);
+                        int w1 = newNode.ofWhich(path);
                         newNode.pointers[w1] = stack.size() - 2;
                         int w2 = newNode.ofWhich(np);
                         newNode.pointers[w2] = stack[pos].pointers[which];
@@ -172,27 +166,27 @@ public:
                     if (cur.hashes[which].empty()) {
                         //new leaf
                         cur.pointers[which] = stack.size();
-                        stack.emplace_back("", hex, value);
+                        stack.emplace_back("", path, value);
                         break;
                     }
                     NodeRat next(cur.hashes[which], io, num_read);
-                    if (next.prefix == hex) {
+                    if (next.prefix == path) {
                         next.value = value;
                         cur.pointers[which] = stack.size();
                         stack.push_back(next);
                         break;
                     }
-                    if (!is_prefix(hex, next.prefix)) {
-                        stack.emplace_back("", hex, value);
+                    if (!path.starts_with(next.prefix)) {
+                        stack.emplace_back("", path, value);
 
-                        std::string newPrefix = common_prefix(hex, next.prefix);
+                        NibblePath newPrefix = path.prefix(path.common_prefix(next.prefix));
                         std::vector<std::string> newHashes;
                         for (int i = 0; i < 16; ++i) {
                             newHashes.emplace_back("");
                         }
                         stack.emplace_back("", newPrefix, newHashes);
                         NodeRat &newNode = stack[stack.size() - 1];
-                        int w1 = newNode.ofWhich(hex);
+                        int w1 = newNode.ofWhich(path);
                         newNode.pointers[w1] = stack.size() - 2;
                         int w2 = newNode.ofWhich(next.prefix);
                         newNode.hashes[w2] = next.hash;
@@ -208,11 +202,12 @@ public:
         _compute(stack, 0);
         list.clear();
         this->digest = stack[0].hash;
+        publish(digest);
         return std::make_pair(num_read, num_write);
     }
 
     std::string gen_proof(const std::string &spos) override {
-        std::string hex(spos), tmp;
+        NibblePath path(spos);
         //io->read(hex, tmp);
         //if (tmp.empty())
         //    return "?";
@@ -223,12 +218,12 @@ public:
         int cnt = 0;
         for ( ; ; ) {
             NodeRat cur(key, io, num_read);
-            if (cur.prefix == hex)
+            if (cur.prefix == path)
                 break;
-            if (!is_prefix(hex, cur.prefix)) {
+            if (!path.starts_with(cur.prefix)) {
                 return "?";
             }
-            int which = cur.ofWhich(hex);
+            int which = cur.ofWhich(path);
             if (cur.hashes[which].empty()) {
                 return "?";
             }
@@ -270,12 +265,52 @@ public:
         return key == digest;
     }
 
+    // Nodes are stored under their own hash, so each is checked against its
+    // key; equal subtrees share their records and are visited once.
+    bool walk(const Visit &visit) override {
+        std::unordered_set<std::string> seen;
+        std::vector<std::string> todo{digest};
+        std::string v, children;
+        while (!todo.empty()) {
+            std::string key = todo.back();
+            todo.pop_back();
+            if (!seen.insert(key).second) {
+                continue;
+            }
+            codec::Record rec;
+            if (!io->read(key, v) || !codec::try_decode(v, rec)) {
+                return false;
+            }
+            children.clear();
+            for (const auto &h : rec.hashes) {
+                children.append(h);
+                if (!h.empty()) {
+                    todo.push_back(h);
+                }
+            }
+            if (calculateSHA256Hash(rec.isLeaf ? rec.value : children) != key) {
+                return false;
+            }
+            visit(key, v);
+        }
+        return visit_root(visit);
+    }
+
     std::string get_name() override {
         return "rat_tree";
     }
 
+    std::string get_digest() override {
+        return digest;
+    }
+    verifier::Family proof_family() override {
+        return verifier::HEX;
+    }
+
     ~RatTree() override {
-        io->flush();
+        if (io != nullptr) {
+            io->discard();
+        }
     }
 };
 
@@ -305,34 +340,20 @@ public:
         this->keyLen = key.find('-');
         isRoot = key[0] == '*';
         this->key = key;
-        if (v[0] == '!') {
-            isLeaf = true;
-            this->value = v.substr(1);
+        codec::Record rec;
+        codec::decode(v, rec);
+        isLeaf = rec.isLeaf;
+        if (isLeaf) {
+            this->value = rec.value;
         } else {
-            isLeaf = false;
-            Int pos = 0, pred = 0;
-            for (int i = 0; i < 16; ++i) {
-                while (v[pos] != ':')
-                    ++pos;
-                keys.emplace_back(v.substr(pred, pos - pred));
-                pred = pos = pos + 1;
-                while (pos < v.length() && v[pos] != ',')
-                    ++pos;
-                hashes.emplace_back(v.substr(pred, pos - pred));
-                pred = pos = pos + 1;
-            }
+            keys = std::move(rec.keys);
+            hashes = std::move(rec.hashes);
         }
     }
     std::string to_string() {
         if (isLeaf)
-            return "!" + value;
-        std::string output;
-        for (int i = 0; i < 16; ++i) {
-            output.append(keys[i] + ":" + hashes[i]);
-            if (i < 15)
-                output.append(",");
-        }
-        return output;
+            return codec::encode_leaf("", nullptr, value);
+        return codec::encode_branch("", nullptr, &keys, &hashes);
     }
     std::string computeHash() {
         if (isLeaf)
@@ -347,7 +368,10 @@ public:
         io->write(key, to_string());
     }
     int ofWhich(const std::string &k) {
-        return hti[k[isRoot ? 0 : keyLen]];
+        return hex_value(k[isRoot ? 0 : keyLen]);
+    }
+    int ofWhich(const NibblePath &k) {
+        return k.nibble(isRoot ? 0 : keyLen);
     }
     bool isPrefixChild(int child, const std::string &k) {
         auto p = keys[child].find('-');
@@ -393,15 +417,22 @@ public:
 
     bool init(IO *io, bool create_db, std::string *values) override {
         this->io = io;
-        if (!this->io->open()) {
+        if (!this->io->open(create_db)) {
             return false;
         }
         if (create_db) {
-            this->io->write("*-0", ":,:,:,:,:,:,:,:,:,:,:,:,:,:,:,:");
-            this->io->flush();
             this->digest = calculateSHA256Hash("");
+            this->io->write("*-0", NodeRatPrefix("*-0", std::vector<std::string>(16), std::vector<std::string>(16)).to_string());
+            version = 0;
+            strver = "0";
+            publish(digest, {version});
         } else {
-            //not available
+            std::vector<Int> counters;
+            if (!recover(digest, counters)) {
+                return false;
+            }
+            version = counters[0];
+            strver = int_to_hex(version);
         }
         return true;
     }
@@ -419,6 +450,7 @@ public:
         std::string hashUp;
         for (const auto& pair : list) {
             std::string hex(pair.first), value(pair.second);
+            NibblePath path(hex);
 
             int cnt = 0;
             Int pos = 0;
@@ -428,7 +460,7 @@ public:
                 }
 
                 NodeRatPrefix &cur = stack[pos];
-                int which = cur.ofWhich(hex);
+                int which = cur.ofWhich(path);
                 if (cur.keys[which].empty()) {
                     cur.keys[which] = hex + "-" + strver;
                     cur.pointers[which] = stack.size();
@@ -453,7 +485,7 @@ public:
                         }
                         stack.emplace_back(newKey, newKeys, newHashes);
                         NodeRatPrefix &newNode = stack[stack.size() - 1];
-                        int w1 = newNode.ofWhich(hex);
+                        int w1 = newNode.ofWhich(path);
                         newNode.keys[w1] = hex + "-" + strver;
                         newNode.pointers[w1] = stack.size() - 2;
                         int w2 = newNode.ofWhich(np);
@@ -483,7 +515,7 @@ public:
                         }
                         stack.emplace_back(newKey, newKeys, newHashes);
                         NodeRatPrefix &newNode = stack[stack.size() - 1];
-                        int w1 = newNode.ofWhich(hex);
+                        int w1 = newNode.ofWhich(path);
                         newNode.keys[w1] = hex + "-" + strver;
                         newNode.pointers[w1] = stack.size() - 2;
                         int w2 = newNode.ofWhich(stack[pos].keys[which]);
@@ -506,11 +538,13 @@ public:
         _compute(stack, 0);
         list.clear();
         this->digest = stack[0].computeHash();
+        publish(digest, {version});
         return std::make_pair(c, c);
     }
 
     std::string gen_proof(const std::string &spos) override {
         std::string hex(spos), tmp;
+        NibblePath path(hex);
         //io->read(hex, tmp);
         //if (tmp.empty())
         //    return "?";
@@ -520,7 +554,7 @@ public:
 
         for ( ; ; ) {
             NodeRatPrefix cur(key, io);
-            int which = cur.ofWhich(hex);
+            int which = cur.ofWhich(path);
             if (cur.keys[which].empty() || !cur.isPrefixChild(which, hex)) {
                 return "?";
             }
@@ -565,12 +599,214 @@ public:
         return key == digest;
     }
 
+    // The hash of the node under key after checking every node under it
+    // against the hashes their parents hold, "" if one is missing or does
+    // not match.
+    std::string walk_node(const std::string &key, const Visit &visit, int depth = 0) {
+        std::string v, children;
+        codec::Record rec;
+        if (depth > verifier::MAX_STEPS || !io->read(key, v) || !codec::try_decode(v, rec)) {
+            return "";
+        }
+        visit(key, v);
+        if (rec.isLeaf) {
+            return calculateSHA256Hash(rec.value);
+        }
+        for (int i = 0; i < 16; ++i) {
+            if (rec.keys[i].empty() != rec.hashes[i].empty()
+                    || (!rec.keys[i].empty() && walk_node(rec.keys[i], visit, depth + 1) != rec.hashes[i])) {
+                return "";
+            }
+            children.append(rec.hashes[i]);
+        }
+        return calculateSHA256Hash(children);
+    }
+
+    bool walk(const Visit &visit) override {
+        return walk_node("*-" + strver, visit) == digest && visit_root(visit);
+    }
+
     std::string get_name() override {
         return "rat_prefix_tree";
     }
 
+    std::string get_digest() override {
+        return digest;
+    }
+    verifier::Family proof_family() override {
+        return verifier::HEX;
+    }
+
     ~RatPrefix() override {
-        io->flush();
+        if (io != nullptr) {
+            io->discard();
+        }
+    }
+};
+
+// Node hashes by versioned key, for the compact trees whose records list
+// their children by key only. A key is written once, so an entry never goes
+// stale; the two generations of at most capacity entries only bound memory,
+// the older being dropped when the newer fills.
+class NodeHashCache {
+    std::unordered_map<std::string, std::string> young, old;
+    size_t capacity;
+
+public:
+    explicit NodeHashCache(size_t capacity) : capacity(capacity) {}
+
+    bool get(const std::string &key, std::string &hash) {
+        auto it = young.find(key);
+        if (it != young.end()) {
+            hash = it->second;
+            return true;
+        }
+        it = old.find(key);
+        if (it == old.end())
+            return false;
+        hash = it->second;
+        put(key, hash);
+        return true;
+    }
+    void put(const std::string &key, const std::string &hash) {
+        if (young.size() >= capacity) {
+            old.swap(young);
+            young.clear();
+        }
+        young[key] = hash;
+    }
+    void clear() {
+        young.clear();
+        old.clear();
+    }
+};
+
+// Deletes the nodes that commits of a versioned trie superseded, once no
+// retained root reaches them. A node superseded by commit c belongs to the
+// roots before c only, so with the last retain versions kept it may go when
+// version c + retain - 1 is committed. collect() deletes at most rate keys per
+// commit, spreading a large commit's garbage over the following ones, and
+// hints io to compact every compact_every deletions. The keys of a commit not
+// yet deleted are also kept in io under list_key(c), so that a reopened trie
+// still deletes them; those are read back one list at a time as they fall due.
+class VersionGC {
+    std::deque<std::pair<Int, std::vector<std::string>>> stale; // commit, keys it superseded
+    size_t next = 0; // keys of stale.front() already deleted
+    Int since_compact = 0;
+    Int disk_from = 1, disk_to = 0; // commits whose lists are in io only
+
+    static std::string list_key(Int version) {
+        return "%" + int_to_hex(version);
+    }
+
+    void save(IO *io, const std::pair<Int, std::vector<std::string>> &list, size_t from) {
+        std::string s;
+        for (size_t i = from; i < list.second.size(); ++i) {
+            s.append(i == from ? "" : ",").append(list.second[i]);
+        }
+        io->write(list_key(list.first), s);
+    }
+
+    void load(IO *io, Int version) {
+        std::string s;
+        std::vector<std::string> keys;
+        if (io->read(list_key(version), s)) {
+            for (size_t i = 0, j; i < s.length(); i = j + 1) {
+                j = s.find(',', i);
+                if (j == std::string::npos)
+                    j = s.length();
+                keys.push_back(s.substr(i, j - i));
+            }
+        }
+        stale.emplace_front(version, std::move(keys));
+    }
+
+public:
+    Int retain; // versions kept, 0 keeps all and tracks nothing
+    Int rate; // deletions per collect(), 0 means no limit
+    Int compact_every = 1 << 20;
+    Int removed = 0;
+
+    VersionGC(Int retain, Int rate) : retain(retain), rate(rate) {}
+
+    void superseded(Int version, const std::string &key) {
+        if (retain <= 0)
+            return;
+        if (stale.empty() || stale.back().first != version)
+            stale.emplace_back(version, std::vector<std::string>());
+        stale.back().second.push_back(key);
+    }
+
+    // After version is committed.
+    void collect(IO *io, Int version) {
+        Int budget = rate > 0 ? rate : std::numeric_limits<Int>::max();
+        while (budget > 0) {
+            // lists from before a reopen are all older than the ones in memory
+            if (disk_from <= disk_to && disk_from + retain - 1 <= version
+                    && (stale.empty() || stale.front().first > disk_to)) {
+                load(io, disk_from++);
+            }
+            if (stale.empty() || stale.front().first + retain - 1 > version)
+                break;
+            const auto &keys = stale.front().second;
+            for (; next < keys.size() && budget > 0; ++next, --budget) {
+                io->remove(keys[next]);
+                ++removed;
+                ++since_compact;
+            }
+            if (next == keys.size()) {
+                if (stale.front().first != version)
+                    io->remove(list_key(stale.front().first));
+                stale.pop_front();
+                next = 0;
+            }
+        }
+        // a reopen goes on from what is saved here
+        if (!stale.empty() && stale.back().first == version)
+            save(io, stale.back(), 0);
+        if (next > 0)
+            save(io, stale.front(), next);
+        if (compact_every > 0 && since_compact >= compact_every) {
+            io->compact();
+            since_compact = 0;
+        }
+    }
+
+    // The oldest commit whose list is not deleted yet, version + 1 if none;
+    // goes into the root record for resume().
+    Int first(Int version) const {
+        Int f = version + 1;
+        if (!stale.empty())
+            f = std::min(f, stale.front().first);
+        if (disk_from <= disk_to)
+            f = std::min(f, disk_from);
+        return f;
+    }
+
+    // Forgets what is in memory; the lists of commits from..to are in io.
+    void resume(Int from, Int to) {
+        stale.clear();
+        next = 0;
+        disk_from = from;
+        disk_to = to;
+    }
+
+    // Visits the lists of the commits whose keys are not all deleted yet.
+    void walk(IO *io, Int version, const MemChecker::Visit &visit) const {
+        std::string s;
+        for (Int v = first(version); v <= version; ++v) {
+            if (io->read(list_key(v), s)) {
+                visit(list_key(v), s);
+            }
+        }
+    }
+
+    // Superseded keys not deleted yet, of the lists in memory.
+    Int backlog() const {
+        Int n = -(Int)next;
+        for (const auto &s : stale)
+            n += (Int)s.second.size();
+        return n;
     }
 };
 
@@ -599,37 +835,27 @@ public:
         std::string v;
         io->read(key, v);
         num += v.length();
-        this->hash = v.substr(0, 64);
-        if (quick)
+        if (quick) {
+            this->hash = codec::peek_hash(v);
             return;
+        }
         this->keyLen = key.find('-');
         isRoot = key[0] == '*';
         this->key = key;
-        v = v.substr(64);
-        if (v[0] == '!') {
-            isLeaf = true;
-            this->value = v.substr(1);
+        codec::Record rec;
+        codec::decode(v, rec);
+        this->hash = rec.hash;
+        isLeaf = rec.isLeaf;
+        if (isLeaf) {
+            this->value = rec.value;
         } else {
-            isLeaf = false;
-            Int pos = 0, pred = 0;
-            for (int i = 0; i < 16; ++i) {
-                while (pos < v.length() && v[pos] != ',')
-                    ++pos;
-                keys.emplace_back(v.substr(pred, pos - pred));
-                pred = pos = pos + 1;
-            }
+            keys = std::move(rec.keys);
         }
     }
     std::string to_string() {
         if (isLeaf)
-            return hash + "!" + value;
-        std::string output(hash);
-        for (int i = 0; i < 16; ++i) {
-            output.append(keys[i]);
-            if (i < 15)
-                output.append(",");
-        }
-        return output;
+            return codec::encode_leaf("", &hash, value);
+        return codec::encode_branch("", &hash, &keys, nullptr);
     }
     void write(IO *io, Int &num) {
         std::string tmp(to_string());
@@ -637,7 +863,10 @@ public:
         io->write(key, tmp);
     }
     int ofWhich(const std::string &k) {
-        return hti[k[isRoot ? 0 : keyLen]];
+        return hex_value(k[isRoot ? 0 : keyLen]);
+    }
+    int ofWhich(const NibblePath &k) {
+        return k.nibble(isRoot ? 0 : keyLen);
     }
     bool isPrefixChild(int child, const std::string &k) {
         auto p = keys[child].find('-');
@@ -654,6 +883,8 @@ public:
 
 class RatCompact : public MemChecker {
     Int num_read, num_write;
+    NodeHashCache hashes;
+    VersionGC gc;
     void _compute(std::vector<NodeRatCompact> &stack, Int pos) {
         NodeRatCompact &cur = stack[pos];
         std::string tmp;
@@ -665,10 +896,7 @@ class RatCompact : public MemChecker {
                     tmp.append(stack[cur.pointers[i]].hash);
                     cur.pointers[i] = -1;
                 } else {
-                    std::string t;
-                    io->read(cur.keys[i], t);
-                    num_read += t.length();
-                    tmp.append(t.substr(0, 64));
+                    tmp.append(child_hash(cur.keys[i]));
                 }
             }
             cur.hash = calculateSHA256Hash(tmp);
@@ -677,6 +905,72 @@ class RatCompact : public MemChecker {
         }
 
         cur.write(io, num_write);
+        hashes.put(cur.key, cur.hash);
+    }
+
+    void check_retained(Int v) const {
+        if (v < 0 || v > version || (gc.retain > 0 && v <= version - gc.retain))
+            throw std::invalid_argument("version " + std::to_string(v) + " is not retained");
+    }
+
+    std::string proof_from(std::string key, const std::string &spos) {
+        std::string hex(spos), tmp;
+        NibblePath path(hex);
+        //io->read(hex, tmp);
+        //if (tmp.empty())
+        //    return "?";
+
+        std::string output;
+
+        for ( ; ; ) {
+            NodeRatCompact cur(key, io, num_read);
+            int which = cur.ofWhich(path);
+            if (cur.keys[which].empty() || !cur.isPrefixChild(which, hex)) {
+                return "?";
+            }
+            //if (cur.isRoot && (isLeft && cur.rightKey.empty() || !isLeft && cur.leftKey.empty())) {
+            //} else
+            {
+                output.append(std::string(1, '0' + which));
+                for (int i = 0; i < 16; ++i) {
+                    if (i != which) {
+                        if (cur.keys[i].empty()) {
+                            output.append(null64);
+                        } else {
+                            output.append(child_hash(cur.keys[i]));
+                        }
+                    }
+                }
+            }
+            if (is_prefix(cur.keys[which], hex)) {
+                break;
+            }
+            key = cur.keys[which];
+        }
+        return output;
+    }
+
+    // version 0 is "0" as init() writes it, int_to_hex(0) is ""
+    static std::string root_key(Int v) {
+        return "*-" + (v == 0 ? std::string("0") : int_to_hex(v));
+    }
+
+    // version -> root digest, kept as long as the version is retained
+    static std::string index_key(Int v) {
+        return "@" + int_to_hex(v);
+    }
+
+    // The hash of a clean child, from io only if no commit wrote or read it lately.
+    std::string child_hash(const std::string &key) {
+        std::string h;
+        if (key.empty() || hashes.get(key, h))
+            return h;
+        std::string t;
+        io->read(key, t);
+        num_read += t.length();
+        h = codec::peek_hash(t);
+        hashes.put(key, h);
+        return h;
     }
 
 protected:
@@ -688,22 +982,36 @@ protected:
     std::vector<std::pair<std::string, std::string>> list;
 
 public:
-    explicit RatCompact(Int height) {
+    // retain > 0 deletes nodes no root of the last retain versions reaches,
+    // at most gc_rate per commit (0 means all that are due).
+    explicit RatCompact(Int height, Int retain = 0, Int gc_rate = 0, size_t hash_cache = 1 << 16)
+            : hashes(hash_cache), gc(retain, gc_rate) {
         this->height = height;
         digest = "";
     }
 
     bool init(IO *io, bool create_db, std::string *values) override {
         this->io = io;
-        if (!this->io->open()) {
+        hashes.clear();
+        if (!this->io->open(create_db)) {
             return false;
         }
         if (create_db) {
             this->digest = calculateSHA256Hash("");
-            this->io->write("*-0", this->digest + ",,,,,,,,,,,,,,,");
-            this->io->flush();
+            this->io->write("*-0", NodeRatCompact("*-0", std::vector<std::string>(16), this->digest).to_string());
+            this->io->write(index_key(0), this->digest);
+            version = 0;
+            strver = "0";
+            gc.resume(1, 0);
+            publish(digest, {version, gc.first(version)});
         } else {
-            //not available
+            std::vector<Int> counters;
+            if (!recover(digest, counters)) {
+                return false;
+            }
+            version = counters[0];
+            strver = int_to_hex(version);
+            gc.resume(counters.size() > 1 ? counters[1] : version + 1, version);
         }
         return true;
     }
@@ -718,9 +1026,12 @@ public:
         stack.emplace_back("*-" + strver, io, num_read);
         ++version;
         strver = int_to_hex(version);
+        gc.superseded(version, stack[0].key);
+        gc.superseded(version, index_key(version - 1));
         stack[0].changeVersion(strver);
         for (const auto& pair : list) {
             std::string hex(pair.first), value(pair.second);
+            NibblePath path(hex);
 
             int cnt = 0;
             Int pos = 0;
@@ -730,7 +1041,7 @@ public:
                 }
 
                 NodeRatCompact &cur = stack[pos];
-                int which = cur.ofWhich(hex);
+                int which = cur.ofWhich(path);
 
                 if (cur.pointers[which] != -1) {
                     NodeRatCompact &next = stack[cur.pointers[which]];
@@ -749,7 +1060,7 @@ public:
                         }
                         stack.emplace_back(newKey, newKeys, "");
                         NodeRatCompact &newNode = stack[stack.size() - 1];
-                        int w1 = newNode.ofWhich(hex);
+                        int w1 = newNode.ofWhich(path);
                         newNode.keys[w1] = hex + "-" + strver;
                         newNode.pointers[w1] = stack.size() - 2;
                         int w2 = newNode.ofWhich(np);
@@ -769,6 +1080,7 @@ public:
                     }
                     //warning below
                     if (is_prefix(cur.keys[which], hex)) {
+                        gc.superseded(version, cur.keys[which]);
                         cur.keys[which] = hex + "-" + strver;
                         cur.pointers[which] = stack.size();
                         stack.emplace_back(hex + "-" + strver, value);
@@ -784,7 +1096,7 @@ public:
                         }
                         stack.emplace_back(newKey, newKeys, "");
                         NodeRatCompact &newNode = stack[stack.size() - 1];
-                        int w1 = newNode.ofWhich(hex);
+                        int w1 = newNode.ofWhich(path);
                         newNode.keys[w1] = hex + "-" + strver;
                         newNode.pointers[w1] = stack.size() - 2;
                         int w2 = newNode.ofWhich(stack[pos].keys[which]);
@@ -793,6 +1105,7 @@ public:
                         stack[pos].pointers[which] = stack.size() - 1;
                         break;
                     }
+                    gc.superseded(version, cur.keys[which]);
                     stack.emplace_back(cur.keys[which], io, num_read);
                     stack[stack.size() - 1].changeVersion(strver);
                     stack[pos].keys[which] = stack[stack.size() - 1].key;
@@ -805,46 +1118,33 @@ public:
         _compute(stack, 0);
         list.clear();
         this->digest = stack[0].hash;
+        io->write(index_key(version), digest);
+        gc.collect(io, version);
+        publish(digest, {version, gc.first(version)});
         return std::make_pair(num_read, num_write);
     }
 
     std::string gen_proof(const std::string &spos) override {
-        std::string hex(spos), tmp;
-        //io->read(hex, tmp);
-        //if (tmp.empty())
-        //    return "?";
+        return proof_from(root_key(version), spos);
+    }
 
-        std::string output;
-        std::string key = "*-" + strver;
+    // The proof of spos against the root committed as version v, which has
+    // to be one of the last retain versions (any version with retain 0).
+    std::string gen_proof_at(Int v, const std::string &spos) {
+        check_retained(v);
+        return proof_from(root_key(v), spos);
+    }
 
-        for ( ; ; ) {
-            NodeRatCompact cur(key, io, num_read);
-            int which = cur.ofWhich(hex);
-            if (cur.keys[which].empty() || !cur.isPrefixChild(which, hex)) {
-                return "?";
-            }
-            //if (cur.isRoot && (isLeft && cur.rightKey.empty() || !isLeft && cur.leftKey.empty())) {
-            //} else
-            {
-                output.append(std::string(1, '0' + which));
-                for (int i = 0; i < 16; ++i) {
-                    if (i != which) {
-                        if (cur.keys[i].empty()) {
-                            output.append(null64);
-                        } else {
-                            std::string t;
-                            io->read(cur.keys[i], t);
-                            output.append(t.substr(0, 64));
-                        }
-                    }
-                }
-            }
-            if (is_prefix(cur.keys[which], hex)) {
-                break;
-            }
-            key = cur.keys[which];
-        }
-        return output;
+    // The root digest committed as version v, for gen_proof_at(v, ...).
+    std::string get_digest_at(Int v) {
+        check_retained(v);
+        std::string d;
+        io->read(index_key(v), d);
+        return d;
+    }
+
+    Int get_version() const {
+        return version;
     }
 
     bool verify_proof(const std::string &spos, const std::string &value, const std::string &proof) override {
@@ -870,12 +1170,72 @@ public:
         return key == digest;
     }
 
+    // The hash of the node under key after checking that every node under it
+    // holds the hash of its children, "" if one is missing or does not
+    // match. checked holds the nodes done, which later versions share.
+    std::string walk_node(const std::string &key, const Visit &visit,
+                          std::unordered_map<std::string, std::string> &checked, int depth = 0) {
+        auto it = checked.find(key);
+        if (it != checked.end()) {
+            return it->second;
+        }
+        std::string v, children;
+        codec::Record rec;
+        if (depth > verifier::MAX_STEPS || !io->read(key, v) || !codec::try_decode(v, rec) || rec.hash.empty()) {
+            return "";
+        }
+        if (!rec.isLeaf) {
+            for (const auto &k : rec.keys) {
+                std::string h;
+                if (!k.empty() && (h = walk_node(k, visit, checked, depth + 1)).empty()) {
+                    return "";
+                }
+                children.append(h);
+            }
+        }
+        if (calculateSHA256Hash(rec.isLeaf ? rec.value : children) != rec.hash) {
+            return "";
+        }
+        visit(key, v);
+        checked[key] = rec.hash;
+        return rec.hash;
+    }
+
+    // Walks the root of every retained version, with its index record and
+    // the lists the collector has still to delete.
+    bool walk(const Visit &visit) override {
+        std::unordered_map<std::string, std::string> checked;
+        std::string d;
+        for (Int v = gc.retain > 0 ? std::max<Int>(0, version - gc.retain + 1) : 0; v <= version; ++v) {
+            if (!io->read(index_key(v), d) || d.empty() || (v == version && d != digest)
+                    || walk_node(root_key(v), visit, checked) != d) {
+                return false;
+            }
+            visit(index_key(v), d);
+        }
+        gc.walk(io, version, visit);
+        return visit_root(visit);
+    }
+
     std::string get_name() override {
         return "rat_compact_tree";
     }
 
+    const VersionGC &get_gc() const {
+        return gc;
+    }
+
+    std::string get_digest() override {
+        return digest;
+    }
+    verifier::Family proof_family() override {
+        return verifier::HEX;
+    }
+
     ~RatCompact() override {
-        io->flush();
+        if (io != nullptr) {
+            io->discard();
+        }
     }
 };
 
@@ -906,37 +1266,27 @@ public:
         if (key.length() < 64)
             throw std::invalid_argument("invalid padding key length");
         num += v.length();
-        this->hash = v.substr(0, 64);
-        if (quick)
+        if (quick) {
+            this->hash = codec::peek_hash(v);
             return;
+        }
         this->keyLen = key.find('-');
         isRoot = key[0] == '*';
         this->key = key;
-        v = v.substr(64);
-        if (v[0] == '!') {
-            isLeaf = true;
-            this->value = v.substr(1);
+        codec::Record rec;
+        codec::decode(v, rec);
+        this->hash = rec.hash;
+        isLeaf = rec.isLeaf;
+        if (isLeaf) {
+            this->value = rec.value;
         } else {
-            isLeaf = false;
-            Int pos = 0, pred = 0;
-            for (int i = 0; i < 16; ++i) {
-                while (pos < v.length() && v[pos] != ',')
-                    ++pos;
-                keys.emplace_back(v.substr(pred, pos - pred));
-                pred = pos = pos + 1;
-            }
+            keys = std::move(rec.keys);
         }
     }
     std::string to_string() {
         if (isLeaf)
-            return hash + "!" + value;
-        std::string output(hash);
-        for (int i = 0; i < 16; ++i) {
-            output.append(keys[i]);
-            if (i < 15)
-                output.append(",");
-        }
-        return output;
+            return codec::encode_leaf("", &hash, value);
+        return codec::encode_branch("", &hash, &keys, nullptr);
     }
     void write(IO *io, Int &num) {
         std::string tmp(to_string());
@@ -946,7 +1296,10 @@ public:
         io->write(key, tmp);
     }
     int ofWhich(const std::string &k) {
-        return hti[k[isRoot ? 0 : keyLen]];
+        return hex_value(k[isRoot ? 0 : keyLen]);
+    }
+    int ofWhich(const NibblePath &k) {
+        return k.nibble(isRoot ? 0 : keyLen);
     }
     bool isPrefixChild(int child, const std::string &k) {
         auto p = keys[child].find('-');
@@ -965,6 +1318,8 @@ public:
 
 class RatPadding : public MemChecker {
     Int num_read, num_write;
+    NodeHashCache hashes;
+    VersionGC gc;
     void _compute(std::vector<NodeRatPadding> &stack, Int pos) {
         NodeRatPadding &cur = stack[pos];
         std::string tmp;
@@ -976,10 +1331,7 @@ class RatPadding : public MemChecker {
                     tmp.append(stack[cur.pointers[i]].hash);
                     cur.pointers[i] = -1;
                 } else {
-                    std::string t;
-                    io->read(cur.keys[i], t);
-                    num_read += t.length();
-                    tmp.append(t.substr(0, 64));
+                    tmp.append(child_hash(cur.keys[i]));
                 }
             }
             cur.hash = calculateSHA256Hash(tmp);
@@ -988,6 +1340,73 @@ class RatPadding : public MemChecker {
         }
 
         cur.write(io, num_write);
+        hashes.put(cur.key, cur.hash);
+    }
+
+    void check_retained(Int v) const {
+        if (v < 0 || v > version || (gc.retain > 0 && v <= version - gc.retain))
+            throw std::invalid_argument("version " + std::to_string(v) + " is not retained");
+    }
+
+    std::string proof_from(std::string key, const std::string &spos) {
+        std::string hex(spos), tmp;
+        NibblePath path(hex);
+        //io->read(hex, tmp);
+        //if (tmp.empty())
+        //    return "?";
+
+        std::string output;
+
+        for ( ; ; ) {
+            NodeRatPadding cur(key, io, num_read);
+            int which = cur.ofWhich(path);
+            if (cur.keys[which].empty() || !cur.isPrefixChild(which, hex)) {
+                return "?";
+            }
+            //if (cur.isRoot && (isLeft && cur.rightKey.empty() || !isLeft && cur.leftKey.empty())) {
+            //} else
+            {
+                output.append(std::string(1, '0' + which));
+                for (int i = 0; i < 16; ++i) {
+                    if (i != which) {
+                        if (cur.keys[i].empty()) {
+                            output.append(null64);
+                        } else {
+                            output.append(child_hash(cur.keys[i]));
+                        }
+                    }
+                }
+            }
+            if (is_prefix(cur.keys[which], hex)) {
+                break;
+            }
+            key = cur.keys[which];
+        }
+        return output;
+    }
+
+    static std::string root_key(Int v) {
+        std::string key = "*-" + (v == 0 ? std::string("0") : int_to_hex(v));
+        while (key.length() < 64)
+            key += "&";
+        return key;
+    }
+
+    static std::string index_key(Int v) {
+        return "@" + int_to_hex(v);
+    }
+
+    // The hash of a clean child, from io only if no commit wrote or read it lately.
+    std::string child_hash(const std::string &key) {
+        std::string h;
+        if (key.empty() || hashes.get(key, h))
+            return h;
+        std::string t;
+        io->read(key, t);
+        num_read += t.length();
+        h = codec::peek_hash(t);
+        hashes.put(key, h);
+        return h;
     }
 
 protected:
@@ -999,22 +1418,38 @@ protected:
     std::vector<std::pair<std::string, std::string>> list;
 
 public:
-    explicit RatPadding(Int height) {
+    // retain and gc_rate as for RatCompact
+    explicit RatPadding(Int height, Int retain = 0, Int gc_rate = 0, size_t hash_cache = 1 << 16)
+            : hashes(hash_cache), gc(retain, gc_rate) {
         this->height = height;
         digest = "";
     }
 
     bool init(IO *io, bool create_db, std::string *values) override {
         this->io = io;
-        if (!this->io->open()) {
+        hashes.clear();
+        if (!this->io->open(create_db)) {
             return false;
         }
         if (create_db) {
             this->digest = calculateSHA256Hash("");
-            this->io->write("*-0&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&&", this->digest + ",,,,,,,,,,,,,,,");
-            this->io->flush();
+            std::string rootKey = "*-0";
+            while (rootKey.length() < 64)
+                rootKey += "&";
+            this->io->write(rootKey, NodeRatPadding(rootKey, std::vector<std::string>(16), this->digest).to_string());
+            this->io->write(index_key(0), this->digest);
+            version = 0;
+            strver = "0";
+            gc.resume(1, 0);
+            publish(digest, {version, gc.first(version)});
         } else {
-            //not available
+            std::vector<Int> counters;
+            if (!recover(digest, counters)) {
+                return false;
+            }
+            version = counters[0];
+            strver = int_to_hex(version);
+            gc.resume(counters.size() > 1 ? counters[1] : version + 1, version);
         }
         return true;
     }
@@ -1032,9 +1467,12 @@ public:
         stack.emplace_back(rootKey, io, num_read);
         ++version;
         strver = int_to_hex(version);
+        gc.superseded(version, stack[0].key);
+        gc.superseded(version, index_key(version - 1));
         stack[0].changeVersion(strver);
         for (const auto& pair : list) {
             std::string hex(pair.first), value(pair.second);
+            NibblePath path(hex);
 
             int cnt = 0;
             Int pos = 0;
@@ -1044,7 +1482,7 @@ public:
                 }
 
                 NodeRatPadding &cur = stack[pos];
-                int which = cur.ofWhich(hex);
+                int which = cur.ofWhich(path);
 
                 if (cur.pointers[which] != -1) {
                     NodeRatPadding &next = stack[cur.pointers[which]];
@@ -1068,7 +1506,7 @@ public:
                         }
                         stack.emplace_back(newKey, newKeys, "");
                         NodeRatPadding &newNode = stack[stack.size() - 1];
-                        int w1 = newNode.ofWhich(hex);
+                        int w1 = newNode.ofWhich(path);
                         newNode.keys[w1] = leafKey;
                         newNode.pointers[w1] = stack.size() - 2;
                         int w2 = newNode.ofWhich(np);
@@ -1091,6 +1529,7 @@ public:
                     }
                     //warning below
                     if (is_prefix(cur.keys[which], hex)) {
+                        gc.superseded(version, cur.keys[which]);
                         std::string leafKey = hex + "-" + strver;
                         while (leafKey.length() < 64)
                             leafKey += "&";
@@ -1114,7 +1553,7 @@ public:
                         }
                         stack.emplace_back(newKey, newKeys, "");
                         NodeRatPadding &newNode = stack[stack.size() - 1];
-                        int w1 = newNode.ofWhich(hex);
+                        int w1 = newNode.ofWhich(path);
                         newNode.keys[w1] = leafKey;
                         newNode.pointers[w1] = stack.size() - 2;
                         int w2 = newNode.ofWhich(stack[pos].keys[which]);
@@ -1123,6 +1562,7 @@ public:
                         stack[pos].pointers[which] = stack.size() - 1;
                         break;
                     }
+                    gc.superseded(version, cur.keys[which]);
                     stack.emplace_back(cur.keys[which], io, num_read);
                     stack[stack.size() - 1].changeVersion(strver);
                     stack[pos].keys[which] = stack[stack.size() - 1].key;
@@ -1135,48 +1575,33 @@ public:
         _compute(stack, 0);
         list.clear();
         this->digest = stack[0].hash;
+        io->write(index_key(version), digest);
+        gc.collect(io, version);
+        publish(digest, {version, gc.first(version)});
         return std::make_pair(num_read, num_write);
     }
 
     std::string gen_proof(const std::string &spos) override {
-        std::string hex(spos), tmp;
-        //io->read(hex, tmp);
-        //if (tmp.empty())
-        //    return "?";
+        return proof_from(root_key(version), spos);
+    }
 
-        std::string output;
-        std::string key = "*-" + strver;
-        while (key.length() < 64)
-            key += "&";
+    // The proof of spos against the root committed as version v, which has
+    // to be one of the last retain versions (any version with retain 0).
+    std::string gen_proof_at(Int v, const std::string &spos) {
+        check_retained(v);
+        return proof_from(root_key(v), spos);
+    }
 
-        for ( ; ; ) {
-            NodeRatPadding cur(key, io, num_read);
-            int which = cur.ofWhich(hex);
-            if (cur.keys[which].empty() || !cur.isPrefixChild(which, hex)) {
-                return "?";
-            }
-            //if (cur.isRoot && (isLeft && cur.rightKey.empty() || !isLeft && cur.leftKey.empty())) {
-            //} else
-            {
-                output.append(std::string(1, '0' + which));
-                for (int i = 0; i < 16; ++i) {
-                    if (i != which) {
-                        if (cur.keys[i].empty()) {
-                            output.append(null64);
-                        } else {
-                            std::string t;
-                            io->read(cur.keys[i], t);
-                            output.append(t.substr(0, 64));
-                        }
-                    }
-                }
-            }
-            if (is_prefix(cur.keys[which], hex)) {
-                break;
-            }
-            key = cur.keys[which];
-        }
-        return output;
+    // The root digest committed as version v, for gen_proof_at(v, ...).
+    std::string get_digest_at(Int v) {
+        check_retained(v);
+        std::string d;
+        io->read(index_key(v), d);
+        return d;
+    }
+
+    Int get_version() const {
+        return version;
     }
 
     bool verify_proof(const std::string &spos, const std::string &value, const std::string &proof) override {
@@ -1202,12 +1627,72 @@ public:
         return key == digest;
     }
 
+    // The hash of the node under key after checking that every node under it
+    // holds the hash of its children, "" if one is missing or does not
+    // match. checked holds the nodes done, which later versions share.
+    std::string walk_node(const std::string &key, const Visit &visit,
+                          std::unordered_map<std::string, std::string> &checked, int depth = 0) {
+        auto it = checked.find(key);
+        if (it != checked.end()) {
+            return it->second;
+        }
+        std::string v, children;
+        codec::Record rec;
+        if (depth > verifier::MAX_STEPS || !io->read(key, v) || !codec::try_decode(v, rec) || rec.hash.empty()) {
+            return "";
+        }
+        if (!rec.isLeaf) {
+            for (const auto &k : rec.keys) {
+                std::string h;
+                if (!k.empty() && (h = walk_node(k, visit, checked, depth + 1)).empty()) {
+                    return "";
+                }
+                children.append(h);
+            }
+        }
+        if (calculateSHA256Hash(rec.isLeaf ? rec.value : children) != rec.hash) {
+            return "";
+        }
+        visit(key, v);
+        checked[key] = rec.hash;
+        return rec.hash;
+    }
+
+    // Walks the root of every retained version, with its index record and
+    // the lists the collector has still to delete.
+    bool walk(const Visit &visit) override {
+        std::unordered_map<std::string, std::string> checked;
+        std::string d;
+        for (Int v = gc.retain > 0 ? std::max<Int>(0, version - gc.retain + 1) : 0; v <= version; ++v) {
+            if (!io->read(index_key(v), d) || d.empty() || (v == version && d != digest)
+                    || walk_node(root_key(v), visit, checked) != d) {
+                return false;
+            }
+            visit(index_key(v), d);
+        }
+        gc.walk(io, version, visit);
+        return visit_root(visit);
+    }
+
     std::string get_name() override {
         return "rat_padding_tree";
     }
 
+    const VersionGC &get_gc() const {
+        return gc;
+    }
+
+    std::string get_digest() override {
+        return digest;
+    }
+    verifier::Family proof_family() override {
+        return verifier::HEX;
+    }
+
     ~RatPadding() override {
-        io->flush();
+        if (io != nullptr) {
+            io->discard();
+        }
     }
 };
 
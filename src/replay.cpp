@@ -0,0 +1,238 @@
+#include "replay.hpp"
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+    // roughly how many ops a worker parses per task
+    const size_t CHUNK_OPS = 8192;
+}
+
+TraceReplay::TraceReplay(std::string path, int threads, size_t queue_chunks, bool compose_values)
+        : path(std::move(path)), queue_chunks(queue_chunks), compose_values(compose_values) {
+    if (threads <= 0) {
+        threads = (int)std::thread::hardware_concurrency() - 1;
+    }
+    num_threads = threads < 1 ? 1 : threads;
+    if (this->queue_chunks < 1) {
+        this->queue_chunks = 1;
+    }
+}
+
+bool TraceReplay::open() {
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    size = st.st_size;
+    if (size > 0) {
+        void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        madvise(p, size, MADV_SEQUENTIAL);
+        data = (const char *)p;
+    }
+    threads.emplace_back(&TraceReplay::scan, this);
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back(&TraceReplay::work, this);
+    }
+    return true;
+}
+
+void TraceReplay::scan() {
+    const char *p = data, *end = data + size;
+    auto next_line = [&](const char *&s, size_t &n) {
+        if (p >= end) {
+            throw std::invalid_argument("truncated trace");
+        }
+        s = p;
+        auto *e = (const char *)std::memchr(p, '\n', end - p);
+        n = (e != nullptr ? e : end) - p;
+        p = e != nullptr ? e + 1 : end;
+    };
+    auto push = [&](Chunk &chunk) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return stopping || chunks.size() < queue_chunks; });
+        if (stopping) {
+            return false;
+        }
+        chunks.push_back(std::move(chunk));
+        cv.notify_all();
+        return true;
+    };
+
+    try {
+        Chunk chunk;
+        size_t chunk_ops = 0;
+        RawBlock cur{0, false, {}};
+        while (p < end) {
+            const char *s;
+            size_t n;
+            next_line(s, n);
+            char type = n > 0 ? s[0] : 0;
+            if (type == 'r' || type == 'w') {
+                RawOp op{type, nullptr, nullptr, 0, 0};
+                do {
+                    next_line(s, n);
+                } while (n > 0 && (s[0] == 'U' || s[0] == 'G'));
+                op.key = s;
+                op.key_len = n;
+                if (type == 'w') {
+                    next_line(op.value, op.value_len);
+                }
+                cur.ops.push_back(op);
+            } else if (type == 'n') {
+                cur.committed = true;
+                chunk_ops += cur.ops.size() + 1;
+                Int number = cur.number;
+                chunk.raw.push_back(std::move(cur));
+                cur = RawBlock{number + 1, false, {}};
+                if (chunk_ops >= CHUNK_OPS) {
+                    if (!push(chunk)) {
+                        return;
+                    }
+                    chunk = Chunk();
+                    chunk_ops = 0;
+                }
+            }
+        }
+        if (!cur.ops.empty()) {
+            chunk.raw.push_back(std::move(cur));
+        }
+        if (!chunk.raw.empty() && !push(chunk)) {
+            return;
+        }
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        scan_error = std::current_exception();
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    scan_done = true;
+    cv.notify_all();
+}
+
+void TraceReplay::work() {
+    for ( ; ; ) {
+        Chunk *chunk;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return stopping || next_raw < popped + chunks.size() || scan_done; });
+            if (stopping || next_raw >= popped + chunks.size()) {
+                return;
+            }
+            // deque references stay valid across push_back and pop_front of other elements
+            chunk = &chunks[next_raw - popped];
+            ++next_raw;
+        }
+        try {
+            chunk->blocks.resize(chunk->raw.size());
+            for (size_t i = 0; i < chunk->raw.size(); ++i) {
+                parse(chunk->raw[i], chunk->blocks[i], compose_values);
+            }
+        } catch (...) {
+            chunk->error = std::current_exception();
+        }
+        chunk->raw.clear();
+        std::lock_guard<std::mutex> lock(mutex);
+        chunk->ready = true;
+        cv.notify_all();
+    }
+}
+
+void TraceReplay::parse(const RawBlock &raw, TraceBlock &block, bool compose) {
+    block.number = raw.number;
+    block.committed = raw.committed;
+    block.ops.resize(raw.ops.size());
+    std::string suffix = "@" + std::to_string(raw.number);
+    for (size_t i = 0; i < raw.ops.size(); ++i) {
+        const RawOp &r = raw.ops[i];
+        TraceOp &op = block.ops[i];
+        op.type = r.type;
+        if (r.key_len < 2) {
+            throw std::invalid_argument("invalid key for write");
+        }
+        op.key.assign(r.key + 2, r.key_len - 2);
+        for (char &c : op.key) {
+            if (c >= 'a' && c <= 'z') {
+                c = char('A' + (c - 'a'));
+            }
+            if ((c < 'A' || c > 'F') && (c < '0' || c > '9'))
+                throw std::invalid_argument("invalid char in key");
+        }
+        if (op.key.length() != 40)
+            throw std::invalid_argument("invalid key for write");
+        if (r.type == 'w' && !compose) {
+            op.value.assign(r.value, r.value_len);
+        } else if (r.type == 'w') {
+            op.value.reserve(op.key.length() + r.value_len + suffix.length());
+            op.value.assign(op.key);
+            op.value.append(r.value, r.value_len);
+            op.value.append(suffix);
+        }
+    }
+}
+
+bool TraceReplay::next(TraceBlock &block) {
+    std::unique_lock<std::mutex> lock(mutex);
+    for ( ; ; ) {
+        if (!chunks.empty() && chunks.front().ready) {
+            Chunk &front = chunks.front();
+            if (front.error) {
+                std::rethrow_exception(front.error);
+            }
+            if (block_pos < front.blocks.size()) {
+                block = std::move(front.blocks[block_pos++]);
+                return true;
+            }
+            chunks.pop_front();
+            ++popped;
+            block_pos = 0;
+            cv.notify_all();
+            continue;
+        }
+        if (chunks.empty() && scan_done) {
+            if (scan_error) {
+                std::rethrow_exception(scan_error);
+            }
+            return false;
+        }
+        cv.wait(lock);
+    }
+}
+
+void TraceReplay::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        cv.notify_all();
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    threads.clear();
+    if (data != nullptr) {
+        munmap((void *)data, size);
+        data = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+TraceReplay::~TraceReplay() {
+    close();
+}
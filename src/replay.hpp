@@ -0,0 +1,83 @@
+#ifndef DUPTREE_REPLAY_HPP
+#define DUPTREE_REPLAY_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include "tools.hpp"
+
+struct TraceOp {
+    char type; // 'r' or 'w'
+    std::string key; // 40 upper-case hex characters
+    std::string value; // as passed to update() (raw trace value if !compose_values), empty for reads
+};
+
+struct TraceBlock {
+    Int number = 0; // 'n' markers seen before this block
+    bool committed = false; // false only for trailing ops without an 'n' marker
+    std::vector<TraceOp> ops;
+};
+
+// Replays an ethXX.txt trace block by block. The file is mmap'd, a scanner
+// thread splits it into blocks, worker threads validate keys and build the
+// ops, and next() hands the blocks out in trace order. At most queue_chunks
+// parsed chunks are held ahead of the consumer. With compose_values, write
+// values are built as key + value + "@" + block number like the benchmarks
+// expect; otherwise the raw trace value is kept.
+class TraceReplay {
+    struct RawOp {
+        char type;
+        const char *key, *value;
+        size_t key_len, value_len;
+    };
+    struct RawBlock {
+        Int number;
+        bool committed;
+        std::vector<RawOp> ops;
+    };
+    struct Chunk {
+        std::vector<RawBlock> raw;
+        std::vector<TraceBlock> blocks;
+        bool ready = false;
+        std::exception_ptr error;
+    };
+
+    std::string path;
+    int num_threads;
+    size_t queue_chunks;
+    bool compose_values;
+
+    int fd = -1;
+    const char *data = nullptr;
+    size_t size = 0;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Chunk> chunks; // in trace order, front is consumed next
+    size_t popped = 0; // chunks already consumed, so chunks[i] is chunk popped + i
+    size_t next_raw = 0; // first chunk not yet handed to a worker
+    bool scan_done = false, stopping = false;
+    std::exception_ptr scan_error;
+    std::vector<std::thread> threads;
+
+    size_t block_pos = 0; // position inside chunks.front().blocks
+
+    void scan();
+    void work();
+    static void parse(const RawBlock &raw, TraceBlock &block, bool compose);
+
+public:
+    explicit TraceReplay(std::string path, int threads = 0, size_t queue_chunks = 64, bool compose_values = true);
+
+    bool open();
+    bool next(TraceBlock &block);
+    void close();
+
+    ~TraceReplay();
+};
+
+#endif //DUPTREE_REPLAY_HPP
@@ -0,0 +1,260 @@
+#include "snapshot.hpp"
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+namespace {
+    const char MAGIC[8] = {'D', 'U', 'P', 'S', 'N', 'A', 'P', '\0'};
+    const uint32_t VERSION = 1;
+    const size_t HASH_BYTES = 32;
+    const size_t CHUNK_HEADER = 8 + HASH_BYTES;
+    const size_t RECORD_HEADER = 8;
+
+    void put_le(std::string &out, uint64_t v, int bytes) {
+        for (int i = 0; i < bytes; ++i) {
+            out.push_back(char(v >> (i * 8)));
+        }
+    }
+
+    uint64_t get_le(const char *p, int bytes) {
+        uint64_t v = 0;
+        for (int i = 0; i < bytes; ++i) {
+            v |= uint64_t((unsigned char)p[i]) << (i * 8);
+        }
+        return v;
+    }
+
+    std::string hash_of(const std::string &data) {
+        return hex_to_bytes(calculateSHA256Hash(data));
+    }
+
+    struct Chunk {
+        std::string raw, packed, hash;
+        size_t raw_bytes = 0;
+        bool ok = true;
+    };
+
+    void pack(Chunk &c) {
+        uLongf len = compressBound(c.raw.size());
+        c.packed.resize(len);
+        compress2((Bytef *)&c.packed[0], &len, (const Bytef *)c.raw.data(), c.raw.size(), Z_DEFAULT_COMPRESSION);
+        c.packed.resize(len);
+        c.hash = hash_of(c.packed);
+    }
+
+    void unpack(Chunk &c) {
+        c.ok = hash_of(c.packed) == c.hash;
+        if (!c.ok) {
+            return;
+        }
+        uLongf len = c.raw_bytes;
+        c.raw.resize(c.raw_bytes);
+        c.ok = uncompress((Bytef *)&c.raw[0], &len, (const Bytef *)c.packed.data(), c.packed.size()) == Z_OK
+                && len == c.raw_bytes;
+    }
+
+    // Runs work on every chunk, up to threads at a time.
+    void parallel(std::vector<Chunk> &chunks, int threads, void (*work)(Chunk &)) {
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> pool;
+        for (int t = 0; t < threads && (size_t)t < chunks.size(); ++t) {
+            pool.emplace_back([&] {
+                for (size_t i; (i = next++) < chunks.size(); ) {
+                    work(chunks[i]);
+                }
+            });
+        }
+        for (auto &t : pool) {
+            t.join();
+        }
+    }
+
+    int thread_count(int threads) {
+        if (threads <= 0) {
+            threads = (int)std::thread::hardware_concurrency();
+        }
+        return std::max(threads, 1);
+    }
+
+    bool read_string(std::ifstream &in, std::string &s) {
+        char len[4];
+        if (!in.read(len, 4)) {
+            return false;
+        }
+        s.resize(get_le(len, 4));
+        return s.empty() || in.read(&s[0], s.size());
+    }
+}
+
+namespace snapshot {
+    bool save(MemChecker *checker, const std::string &digest, const std::string &path,
+              Stats *stats, size_t chunk_bytes, int threads) {
+        if (digest != checker->get_digest()) {
+            throw std::invalid_argument(digest + " is not the last commit of " + checker->get_name());
+        }
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        threads = thread_count(threads);
+        std::string head(MAGIC, sizeof(MAGIC)), name = checker->get_name();
+        put_le(head, VERSION, 4);
+        put_le(head, name.length(), 4);
+        head.append(name);
+        put_le(head, digest.length(), 4);
+        head.append(digest);
+        out.write(head.data(), head.size());
+
+        Stats st;
+        std::string chain;
+        std::vector<Chunk> batch;
+        auto write_batch = [&] {
+            parallel(batch, threads, pack);
+            for (const Chunk &c : batch) {
+                std::string h;
+                put_le(h, c.raw.size(), 4);
+                put_le(h, c.packed.size(), 4);
+                h.append(c.hash);
+                out.write(h.data(), h.size());
+                out.write(c.packed.data(), c.packed.size());
+                chain.append(c.hash);
+                ++st.chunks;
+                st.raw_bytes += c.raw.size();
+                st.packed_bytes += c.packed.size();
+            }
+            batch.clear();
+        };
+        bool walked = checker->walk([&](const std::string &key, const std::string &value) {
+            if (batch.empty() || batch.back().raw.size() >= chunk_bytes) {
+                if (batch.size() == (size_t)threads) {
+                    write_batch();
+                }
+                batch.emplace_back();
+            }
+            std::string &raw = batch.back().raw;
+            put_le(raw, key.length(), 4);
+            put_le(raw, value.length(), 4);
+            raw.append(key).append(value);
+            ++st.records;
+        });
+        write_batch();
+
+        std::string end;
+        put_le(end, 0, 4);
+        put_le(end, 0, 4);
+        end.append(hash_of(chain));
+        put_le(end, st.records, 8);
+        out.write(end.data(), end.size());
+        out.flush();
+        if (stats) {
+            *stats = st;
+        }
+        return walked && (bool)out;
+    }
+
+    bool load(MemChecker *checker, IO *io, const std::string &path, const std::string &root, Stats *stats,
+              int threads) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            return false;
+        }
+        char magic[sizeof(MAGIC) + 4];
+        std::string name, digest;
+        if (!in.read(magic, sizeof(magic)) || std::string(magic, sizeof(MAGIC)) != std::string(MAGIC, sizeof(MAGIC))
+                || get_le(magic + sizeof(MAGIC), 4) != VERSION || !read_string(in, name) || !read_string(in, digest)) {
+            throw std::invalid_argument(path + " is not a snapshot");
+        }
+        if (name != checker->get_name()) {
+            throw std::invalid_argument(path + " is a snapshot of " + name + ", not " + checker->get_name());
+        }
+        if (digest != root || !io->open(true)) {
+            return false;
+        }
+        threads = thread_count(threads);
+
+        Stats st;
+        std::string chain, root_record;
+        std::vector<Chunk> batch;
+        bool ok = true, ended = false;
+        auto load_batch = [&] {
+            parallel(batch, threads, unpack);
+            for (const Chunk &c : batch) {
+                ok = ok && c.ok;
+                for (size_t p = 0; ok && p < c.raw.size(); ) {
+                    if (c.raw.size() - p < RECORD_HEADER) {
+                        ok = false;
+                        break;
+                    }
+                    size_t klen = get_le(&c.raw[p], 4), vlen = get_le(&c.raw[p + 4], 4);
+                    if (c.raw.size() - p - RECORD_HEADER < klen + vlen) {
+                        ok = false;
+                        break;
+                    }
+                    std::string key(&c.raw[p + RECORD_HEADER], klen);
+                    std::string value(&c.raw[p + RECORD_HEADER + klen], vlen);
+                    // the root record goes in last, so a load cut short leaves
+                    // nothing for init(io, false) to open
+                    if (key == MemChecker::ROOT_KEY) {
+                        root_record = value;
+                    } else {
+                        io->write(key, value);
+                    }
+                    ++st.records;
+                    p += RECORD_HEADER + klen + vlen;
+                }
+                ++st.chunks;
+                st.raw_bytes += c.raw_bytes;
+                st.packed_bytes += c.packed.size();
+            }
+            batch.clear();
+        };
+        while (ok && !ended) {
+            char h[CHUNK_HEADER];
+            if (!in.read(h, CHUNK_HEADER)) {
+                break;
+            }
+            size_t raw_bytes = get_le(h, 4), packed_bytes = get_le(h + 4, 4);
+            if (raw_bytes == 0 && packed_bytes == 0) {
+                char records[8];
+                ended = in.read(records, 8) && hash_of(chain) == std::string(h + 8, HASH_BYTES);
+                load_batch();
+                ok = ok && ended && (Int)get_le(records, 8) == st.records;
+                break;
+            }
+            batch.emplace_back();
+            Chunk &c = batch.back();
+            c.raw_bytes = raw_bytes;
+            c.hash.assign(h + 8, HASH_BYTES);
+            c.packed.resize(packed_bytes);
+            if (!in.read(&c.packed[0], packed_bytes)) {
+                break;
+            }
+            chain.append(c.hash);
+            if (batch.size() == (size_t)threads) {
+                load_batch();
+            }
+        }
+        if (stats) {
+            *stats = st;
+        }
+        if (!ok || !ended || root_record.empty()) {
+            io->open(true);
+            return false;
+        }
+        io->write(MemChecker::ROOT_KEY, root_record);
+        io->flush();
+        // the chunk hashes only tie the records to the file; the walk ties
+        // them to root, and the count leaves no record it did not reach
+        Int walked = 0;
+        if (!checker->init(io, false, nullptr) || checker->get_digest() != root
+                || !checker->walk([&](const std::string &, const std::string &) { ++walked; }) || walked != st.records) {
+            io->open(true);
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef DUPTREE_SNAPSHOT_HPP
+#define DUPTREE_SNAPSHOT_HPP
+
+#include <string>
+#include "mem_checker.hpp"
+
+// The records a checker's walk() finds at one commit, its live nodes and what
+// a reopen reads besides, as a stream of zlib compressed chunks that can be
+// checked and loaded independently.
+//
+//   header: "DUPSNAP\0" [version u32][name length u32][name][digest length u32][digest]
+//   chunk:  [raw bytes u32][packed bytes u32][SHA-256 of packed 32][packed]
+//   end:    [0 u32][0 u32][SHA-256 of all chunk hashes 32][records u64]
+//
+// A chunk inflates to records [key length u32][value length u32][key][value];
+// integers are little-endian. The final hash ties the chunks together, so a
+// chunk that is missing, repeated or out of place fails like a damaged one.
+namespace snapshot {
+    struct Stats {
+        Int chunks = 0, records = 0;
+        Int raw_bytes = 0, packed_bytes = 0;
+    };
+
+    // Streams what checker->walk() visits from its last commit, which has to
+    // have digest as its root, into path, compressing up to threads chunks of
+    // about chunk_bytes at once (0 threads means hardware threads). False if
+    // path cannot be written or the walk finds a node that does not match.
+    bool save(MemChecker *checker, const std::string &digest, const std::string &path,
+              Stats *stats = nullptr, size_t chunk_bytes = 1 << 22, int threads = 0);
+
+    // Loads path into io, recreated empty, checking and inflating chunks on
+    // threads in parallel, then opens checker on it with init(io, false).
+    // False, with io left empty, unless the snapshot was saved at root,
+    // every chunk matches its hash, checker comes up with root as its
+    // digest and checker->walk() from there matches and reaches every
+    // record loaded. Throws std::invalid_argument if path is not a snapshot
+    // of this kind of checker.
+    bool load(MemChecker *checker, IO *io, const std::string &path, const std::string &root,
+              Stats *stats = nullptr, int threads = 0);
+}
+
+#endif //DUPTREE_SNAPSHOT_HPP
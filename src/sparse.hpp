@@ -2,6 +2,7 @@
 #define DUPTREE_SPARSE_HPP
 
 #include "mem_checker.hpp"
+#include "codec.hpp"
 
 class NodeSparse {
 public:
@@ -27,27 +28,23 @@ public:
         io->read(key, v);
         isRoot = key == "*";
         this->key = key;
-        if (v[0] == '!') {
-            isLeaf = true;
-            this->value = v.substr(1);
+        codec::Record rec;
+        codec::decode(v, rec, 2);
+        isLeaf = rec.isLeaf;
+        if (isLeaf) {
+            this->value = rec.value;
         } else {
-            isLeaf = false;
-            auto q = v.find(',');
-            if (q != 1) {
-                auto p = v.find(':');
-                leftKey = v.substr(0, p);
-                leftHash = v.substr(p + 1, 64);
-            }
-            if (q != v.length() - 2) {
-                v = v.substr(q + 1);
-                auto p = v.find(':');
-                rightKey = v.substr(0, p);
-                rightHash = v.substr(p + 1, 64);
-            }
+            leftKey = rec.keys[0];
+            leftHash = rec.hashes[0];
+            rightKey = rec.keys[1];
+            rightHash = rec.hashes[1];
         }
     }
     std::string to_string() {
-        return isLeaf ? "!" + value : leftKey + ":" + leftHash + "," + rightKey + ":" + rightHash;
+        if (isLeaf)
+            return codec::encode_leaf("", nullptr, value);
+        std::vector<std::string> ks = {leftKey, rightKey}, hs = {leftHash, rightHash};
+        return codec::encode_branch("", nullptr, &ks, &hs);
     }
     std::string computeHash() {
         return isLeaf ? calculateSHA256Hash(value) : calculateSHA256Hash(leftHash + rightHash);
@@ -82,15 +79,18 @@ public:
 
     bool init(IO *io, bool create_db, std::string *values) override {
         this->io = io;
-        if (!this->io->open()) {
+        if (!this->io->open(create_db)) {
             return false;
         }
         if (create_db) {
-            this->io->write("*", ":,:");
-            this->io->flush();
+            this->io->write("*", NodeSparse("*", "", "", "", "").to_string());
             this->digest = calculateSHA256Hash("");
+            commit();
         } else {
-            //not available
+            std::vector<Int> counters;
+            if (!recover(digest, counters)) {
+                return false;
+            }
         }
         return true;
     }
@@ -207,12 +207,53 @@ public:
         return key == digest;
     }
 
+    std::pair<Int, Int> commit() override {
+        publish(digest);
+        return {0, 0};
+    }
+
+    // The hash of the node under key after checking every node under it
+    // against the hashes their parents hold, "" if one is missing or does
+    // not match.
+    std::string walk_node(const std::string &key, const Visit &visit, int depth = 0) {
+        std::string v, children;
+        codec::Record rec;
+        if (depth > verifier::MAX_STEPS || !io->read(key, v) || !codec::try_decode(v, rec, 2)) {
+            return "";
+        }
+        visit(key, v);
+        if (rec.isLeaf) {
+            return calculateSHA256Hash(rec.value);
+        }
+        for (int i = 0; i < 2; ++i) {
+            if (rec.keys[i].empty() != rec.hashes[i].empty()
+                    || (!rec.keys[i].empty() && walk_node(rec.keys[i], visit, depth + 1) != rec.hashes[i])) {
+                return "";
+            }
+            children.append(rec.hashes[i]);
+        }
+        return calculateSHA256Hash(children);
+    }
+
+    bool walk(const Visit &visit) override {
+        return walk_node("*", visit) == digest && visit_root(visit);
+    }
+
     std::string get_name() override {
         return "sparse_simple";
     }
 
+    std::string get_digest() override {
+        return digest;
+    }
+    verifier::Family proof_family() override {
+        return verifier::SPARSE;
+    }
+
     ~SparseSimple() override {
-        io->flush();
+        if (io != nullptr) {
+            io->discard();
+        }
     }
 };
 
@@ -233,15 +274,19 @@ public:
 
     bool init(IO *io, bool create_db, std::string *values) override {
         this->io = io;
-        if (!this->io->open()) {
+        if (!this->io->open(create_db)) {
             return false;
         }
         if (create_db) {
-            this->io->write("*", ":,:");
-            this->io->flush();
+            this->io->write("*", NodeSparse("*", "", "", "", "").to_string());
             this->digest = calculateSHA256Hash("");
+            commit();
         } else {
-            //not available
+            std::vector<Int> counters;
+            if (!recover(digest, counters)) {
+                return false;
+            }
+            num_leaf = counters[0];
         }
         return true;
     }
@@ -369,12 +414,26 @@ public:
         return key == digest;
     }
 
+    std::pair<Int, Int> commit() override {
+        publish(digest, {num_leaf});
+        return {0, 0};
+    }
+
     std::string get_name() override {
         return "sparse_balance";
     }
 
+    std::string get_digest() override {
+        return digest;
+    }
+    verifier::Family proof_family() override {
+        return verifier::SPARSE;
+    }
+
     ~SparseBalance() override {
-        io->flush();
+        if (io != nullptr) {
+            io->discard();
+        }
     }
 };
 
@@ -400,19 +459,21 @@ public:
         io->read(key, v);
         isRoot = key == "@";
         this->key = key;
-        if (v[0] == '!') {
-            isLeaf = true;
-            this->value = v.substr(1);
+        codec::Record rec;
+        codec::decode(v, rec, 2);
+        isLeaf = rec.isLeaf;
+        if (isLeaf) {
+            this->value = rec.value;
         } else {
-            isLeaf = false;
-            leftHash = v.substr(0, 64);
-            if (v.length() > 64) {
-                rightHash = v.substr(64, 64);
-            }
+            leftHash = rec.hashes[0];
+            rightHash = rec.hashes[1];
         }
     }
     std::string to_string() {
-        return isLeaf ? "!" + value : leftHash + rightHash;
+        if (isLeaf)
+            return codec::encode_leaf("", nullptr, value);
+        std::vector<std::string> hs = {leftHash, rightHash};
+        return codec::encode_branch("", nullptr, nullptr, &hs);
     }
     std::string computeHash() {
         return isLeaf ? calculateSHA256Hash(value) : calculateSHA256Hash(leftHash + rightHash);
@@ -439,15 +500,19 @@ public:
 
     bool init(IO *io, bool create_db, std::string *values) override {
         this->io = io;
-        if (!this->io->open()) {
+        if (!this->io->open(create_db)) {
             return false;
         }
         if (create_db) {
-            this->io->write("@", "");
-            this->io->flush();
+            this->io->write("@", NodeMint("@", "", "").to_string());
             this->digest = calculateSHA256Hash("");
+            commit();
         } else {
-            //not available
+            std::vector<Int> counters;
+            if (!recover(digest, counters)) {
+                return false;
+            }
+            num_leaf = counters[0];
         }
         return true;
     }
@@ -583,12 +648,26 @@ public:
         return key == digest;
     }
 
+    std::pair<Int, Int> commit() override {
+        publish(digest, {num_leaf});
+        return {0, 0};
+    }
+
     std::string get_name() override {
         return "sparse_mint";
     }
 
+    std::string get_digest() override {
+        return digest;
+    }
+    verifier::Family proof_family() override {
+        return verifier::SPARSE;
+    }
+
     ~SparseMint() override {
-        io->flush();
+        if (io != nullptr) {
+            io->discard();
+        }
     }
 };
 
@@ -614,19 +693,21 @@ public:
         io->read(key, v);
         isRoot = key == "*";
         this->key = key;
-        if (v[0] == '!') {
-            isLeaf = true;
-            this->value = v.substr(1);
+        codec::Record rec;
+        codec::decode(v, rec, 2);
+        isLeaf = rec.isLeaf;
+        if (isLeaf) {
+            this->value = rec.value;
         } else {
-            isLeaf = false;
-            leftHash = v.substr(0, 64);
-            if (v.length() > 64) {
-                rightHash = v.substr(64, 64);
-            }
+            leftHash = rec.hashes[0];
+            rightHash = rec.hashes[1];
         }
     }
     std::string to_string() {
-        return isLeaf ? "!" + value : leftHash + rightHash;
+        if (isLeaf)
+            return codec::encode_leaf("", nullptr, value);
+        std::vector<std::string> hs = {leftHash, rightHash};
+        return codec::encode_branch("", nullptr, nullptr, &hs);
     }
     std::string computeHash() {
         return isLeaf ? calculateSHA256Hash(value) : calculateSHA256Hash(leftHash + rightHash);
@@ -653,15 +734,19 @@ public:
 
     bool init(IO *io, bool create_db, std::string *values) override {
         this->io = io;
-        if (!this->io->open()) {
+        if (!this->io->open(create_db)) {
             return false;
         }
         if (create_db) {
-            this->io->write("*", "");
-            this->io->flush();
+            this->io->write("*", NodeMint2("*", "", "").to_string());
             this->digest = calculateSHA256Hash("");
+            commit();
         } else {
-            //not available
+            std::vector<Int> counters;
+            if (!recover(digest, counters)) {
+                return false;
+            }
+            num_leaf = counters[0];
         }
         return true;
     }
@@ -768,12 +853,26 @@ public:
         return key == digest;
     }
 
+    std::pair<Int, Int> commit() override {
+        publish(digest, {num_leaf});
+        return {0, 0};
+    }
+
     std::string get_name() override {
         return "sparse_mint2 Original";
     }
 
+    std::string get_digest() override {
+        return digest;
+    }
+    verifier::Family proof_family() override {
+        return verifier::SPARSE;
+    }
+
     ~SparseMint2() override {
-        io->flush();
+        if (io != nullptr) {
+            io->discard();
+        }
     }
 };
 
@@ -1,27 +1,221 @@
 #include "tools.hpp"
+#include "profiler.hpp"
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <openssl/sha.h>
+#include <openssl/evp.h>
+#include <memory>
 #include <vector>
 #include <random>
 #include <chrono>
 #include <iomanip>
 #include <algorithm>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+// The vector routines below are compiled for their own ISA whatever the
+// build targets, and used only where the CPU running them has it.
+#define DUPTREE_X86 1
+
+namespace {
+    struct Cpu {
+        bool ssse3, sse42, avx2, sha;
+        Cpu() {
+            __builtin_cpu_init();
+            ssse3 = __builtin_cpu_supports("ssse3");
+            sse42 = __builtin_cpu_supports("sse4.2");
+            avx2 = __builtin_cpu_supports("avx2");
+            sha = __builtin_cpu_supports("sha");
+        }
+    };
+
+    const Cpu &cpu() {
+        static const Cpu c;
+        return c;
+    }
+}
+#endif
 
 std::string calculateSHA256Hash(const std::string& data) {
+    prof::Scope scope(prof::HASH);
     unsigned char hash[SHA256_DIGEST_LENGTH];
     SHA256_CTX sha256;
     SHA256_Init(&sha256);
     SHA256_Update(&sha256, data.c_str(), data.length());
     SHA256_Final(hash, &sha256);
-    std::stringstream ss;
-    for (int j = 0; j < 1; ++j) {
-        for (unsigned char i : hash) {
-            ss << std::setfill('0') << std::setw(2) << std::hex << static_cast<Int>(i);
+    return bytes_to_hex((const char *)hash, SHA256_DIGEST_LENGTH);
+}
+
+#if defined(DUPTREE_X86)
+namespace {
+    const uint32_t SHA256_K[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+    __attribute__((target("avx2"))) inline __m256i rotr(__m256i x, int n) {
+        return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+    }
+
+    // One 64-byte block of each lane; words[t][lane] already big-endian decoded.
+    __attribute__((target("avx2"))) void sha256_x8_block(__m256i state[8], const uint32_t words[16][8]) {
+        __m256i w[64];
+        for (int t = 0; t < 16; ++t) {
+            w[t] = _mm256_loadu_si256((const __m256i *)words[t]);
+        }
+        for (int t = 16; t < 64; ++t) {
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr(w[t - 15], 7), rotr(w[t - 15], 18)),
+                                          _mm256_srli_epi32(w[t - 15], 3));
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr(w[t - 2], 17), rotr(w[t - 2], 19)),
+                                          _mm256_srli_epi32(w[t - 2], 10));
+            w[t] = _mm256_add_epi32(_mm256_add_epi32(w[t - 16], s0), _mm256_add_epi32(w[t - 7], s1));
+        }
+        __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+        __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int t = 0; t < 64; ++t) {
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr(e, 6), rotr(e, 11)), rotr(e, 25));
+            __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+            __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, s1),
+                                          _mm256_add_epi32(ch, _mm256_add_epi32(_mm256_set1_epi32((int)SHA256_K[t]), w[t])));
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr(a, 2), rotr(a, 13)), rotr(a, 22));
+            __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+            __m256i t2 = _mm256_add_epi32(s0, maj);
+            h = g;
+            g = f;
+            f = e;
+            e = _mm256_add_epi32(d, t1);
+            d = c;
+            c = b;
+            b = a;
+            a = _mm256_add_epi32(t1, t2);
+        }
+        state[0] = _mm256_add_epi32(state[0], a);
+        state[1] = _mm256_add_epi32(state[1], b);
+        state[2] = _mm256_add_epi32(state[2], c);
+        state[3] = _mm256_add_epi32(state[3], d);
+        state[4] = _mm256_add_epi32(state[4], e);
+        state[5] = _mm256_add_epi32(state[5], f);
+        state[6] = _mm256_add_epi32(state[6], g);
+        state[7] = _mm256_add_epi32(state[7], h);
+    }
+
+    __attribute__((target("avx2"))) void sha256_x8_avx2(const char *const data[8], size_t len, unsigned char *out) {
+        const uint32_t init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+        __m256i state[8];
+        for (int i = 0; i < 8; ++i) {
+            state[i] = _mm256_set1_epi32((int)init[i]);
+        }
+        // whole blocks straight from the input, then one or two padded tail blocks
+        size_t full = len / 64, tail_blocks = len % 64 + 9 > 64 ? 2 : 1;
+        unsigned char tail[8][128];
+        for (int l = 0; l < 8; ++l) {
+            size_t rest = len % 64;
+            std::memset(tail[l], 0, sizeof(tail[l]));
+            std::memcpy(tail[l], data[l] + full * 64, rest);
+            tail[l][rest] = 0x80;
+            uint64_t bits = (uint64_t)len * 8;
+            for (int i = 0; i < 8; ++i) {
+                tail[l][tail_blocks * 64 - 1 - i] = (unsigned char)(bits >> (8 * i));
+            }
+        }
+        uint32_t words[16][8];
+        for (size_t b = 0; b < full + tail_blocks; ++b) {
+            for (int l = 0; l < 8; ++l) {
+                const unsigned char *p = b < full ? (const unsigned char *)data[l] + b * 64 : tail[l] + (b - full) * 64;
+                for (int t = 0; t < 16; ++t) {
+                    uint32_t v;
+                    std::memcpy(&v, p + t * 4, 4);
+                    words[t][l] = __builtin_bswap32(v);
+                }
+            }
+            sha256_x8_block(state, words);
+        }
+        uint32_t lanes[8][8];
+        for (int i = 0; i < 8; ++i) {
+            _mm256_storeu_si256((__m256i *)lanes[i], state[i]);
+        }
+        for (int l = 0; l < 8; ++l) {
+            for (int i = 0; i < 8; ++i) {
+                uint32_t v = __builtin_bswap32(lanes[i][l]);
+                std::memcpy(out + l * 32 + i * 4, &v, 4);
+            }
         }
     }
-    return ss.str();
+}
+#endif
+
+void sha256(const char *data, size_t len, unsigned char *out) {
+    // the implementation is looked up once, not per call as EVP_sha256() is
+    // on OpenSSL 3, and each thread keeps its context
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    static const EVP_MD *md = EVP_MD_fetch(nullptr, "SHA256", nullptr);
+#else
+    static const EVP_MD *md = EVP_sha256();
+#endif
+    thread_local std::unique_ptr<EVP_MD_CTX, void (*)(EVP_MD_CTX *)> ctx(EVP_MD_CTX_new(), EVP_MD_CTX_free);
+    EVP_DigestInit_ex(ctx.get(), md, nullptr);
+    EVP_DigestUpdate(ctx.get(), data, len);
+    EVP_DigestFinal_ex(ctx.get(), out, nullptr);
+}
+
+void sha256_x8(const char *const data[8], size_t len, unsigned char *out) {
+    prof::Scope scope(prof::HASH);
+#if defined(DUPTREE_X86)
+    // OpenSSL's SHA-NI code hashes one message faster than eight lanes do
+    if (cpu().avx2 && !cpu().sha) {
+        sha256_x8_avx2(data, len, out);
+        return;
+    }
+#endif
+    for (int l = 0; l < 8; ++l) {
+        sha256(data[l], len, out + l * 32);
+    }
+}
+
+#if defined(DUPTREE_X86)
+__attribute__((target("sse4.2"))) static uint32_t crc32c_sse42(const char *data, size_t len, uint32_t crc) {
+    uint64_t c = ~crc;
+    for (; len >= 8; data += 8, len -= 8) {
+        uint64_t v;
+        std::memcpy(&v, data, 8);
+        c = _mm_crc32_u64(c, v);
+    }
+    auto c32 = (uint32_t)c;
+    for (; len > 0; ++data, --len) {
+        c32 = _mm_crc32_u8(c32, (unsigned char)*data);
+    }
+    return ~c32;
+}
+#endif
+
+uint32_t crc32c(const char *data, size_t len, uint32_t crc) {
+#if defined(DUPTREE_X86)
+    if (cpu().sse42)
+        return crc32c_sse42(data, len, crc);
+#endif
+    static const auto table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) != 0 ? 0x82F63B78 ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (; len > 0; ++data, --len) {
+        crc = table[(crc ^ (unsigned char)*data) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
 }
 
 std::string random_string(Int len) {
@@ -32,6 +226,14 @@ std::string random_string(Int len) {
     return ss.str();
 }
 
+std::string random_digest(std::mt19937_64 &rng) {
+    uint64_t words[4];
+    for (auto &w : words) {
+        w = rng();
+    }
+    return bytes_to_hex((const char *)words, sizeof(words));
+}
+
 Int up_to(Int x, Int v) {
     while (x * 2 < v) {
         x *= 2;
@@ -54,59 +256,21 @@ void random_sample(std::vector<Int> &sample, Int number, Int max_value) {
     }
 }
 
-std::map<char, std::string> htb = {
-        {'0', "0000"},
-        {'1', "0001"},
-        {'2', "0010"},
-        {'3', "0011"},
-        {'4', "0100"},
-        {'5', "0101"},
-        {'6', "0110"},
-        {'7', "0111"},
-        {'8', "1000"},
-        {'9', "1001"},
-        {'A', "1010"},
-        {'B', "1011"},
-        {'C', "1100"},
-        {'D', "1101"},
-        {'E', "1110"},
-        {'F', "1111"}};
-
-std::map<char, int> hti = {
-        {'0', 0},
-        {'1', 1},
-        {'2', 2},
-        {'3', 3},
-        {'4', 4},
-        {'5', 5},
-        {'6', 6},
-        {'7', 7},
-        {'8', 8},
-        {'9', 9},
-        {'A', 10},
-        {'B', 11},
-        {'C', 12},
-        {'D', 13},
-        {'E', 14},
-        {'F', 15},
-        {'a', 10},
-        {'b', 11},
-        {'c', 12},
-        {'d', 13},
-        {'e', 14},
-        {'f', 15}};
-
 std::string null64 = "@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@";
 
 std::string hex_to_binary(const std::string &hex) {
-    std::string output;
+    static const char bits[16][5] = {
+            "0000", "0001", "0010", "0011", "0100", "0101", "0110", "0111",
+            "1000", "1001", "1010", "1011", "1100", "1101", "1110", "1111"};
+    std::string output(hex.length() * 4, '0');
+    size_t n = 0;
     for (char i : hex) {
-        char j = i;
-        if (j >= 'a' && j <= 'z') {
-            j = 'A' + (j - 'a');
-        }
-        output.append(htb[j]);
+        if (!is_hex(i))
+            continue;
+        std::memcpy(&output[n], bits[hex_value(i)], 4);
+        n += 4;
     }
+    output.resize(n);
     return output;
 }
 
@@ -159,20 +323,129 @@ std::string int_to_hex(Int decimal) {
     return hex;
 }
 
+#if defined(DUPTREE_X86)
+// Nibble values of 16 hex characters, or false if any of them is not hex.
+__attribute__((target("ssse3"))) static inline bool decode_nibbles(__m128i c, __m128i &v) {
+    const __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    const __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    const __m128i alpha = _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10));
+    const __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+    const __m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha)) != 0xffff)
+        return false;
+    v = _mm_or_si128(_mm_and_si128(is_digit, digit), _mm_andnot_si128(is_digit, alpha));
+    return true;
+}
+
+// 32 characters -> 16 bytes: hi * 16 + lo per pair, then narrow. Returns the
+// bytes done; stops early at a character that is not hex.
+__attribute__((target("ssse3"))) static size_t hex_to_bytes_ssse3(const char *in, char *out, size_t n) {
+    const __m128i weights = _mm_set1_epi16(0x0110);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v0, v1;
+        if (!decode_nibbles(_mm_loadu_si128((const __m128i *)(in + i * 2)), v0) ||
+            !decode_nibbles(_mm_loadu_si128((const __m128i *)(in + i * 2 + 16)), v1))
+            break;
+        __m128i p = _mm_packus_epi16(_mm_maddubs_epi16(v0, weights), _mm_maddubs_epi16(v1, weights));
+        _mm_storeu_si128((__m128i *)(out + i), p);
+    }
+    return i;
+}
+
+// Encodes bytes [i, len) 32 at a time; returns where it stopped.
+__attribute__((target("avx2"))) static size_t bytes_to_hex_avx2(const char *bytes, size_t i, size_t len, char *hex, char a) {
+    const __m256i table = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', a, char(a + 1), char(a + 2), char(a + 3), char(a + 4), char(a + 5),
+                                           '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', a, char(a + 1), char(a + 2), char(a + 3), char(a + 4), char(a + 5));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    for (; i + 32 <= len; i += 32) {
+        __m256i b = _mm256_loadu_si256((const __m256i *)(bytes + i));
+        __m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(b, 4), mask));
+        __m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(b, mask));
+        __m256i x = _mm256_unpacklo_epi8(hi, lo), y = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256((__m256i *)(hex + i * 2), _mm256_permute2x128_si256(x, y, 0x20));
+        _mm256_storeu_si256((__m256i *)(hex + i * 2 + 32), _mm256_permute2x128_si256(x, y, 0x31));
+    }
+    return i;
+}
+
+// The same 16 at a time.
+__attribute__((target("ssse3"))) static size_t bytes_to_hex_ssse3(const char *bytes, size_t i, size_t len, char *hex, char a) {
+    const __m128i table16 = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', a, char(a + 1), char(a + 2), char(a + 3), char(a + 4), char(a + 5));
+    const __m128i mask16 = _mm_set1_epi8(0x0f);
+    for (; i + 16 <= len; i += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *)(bytes + i));
+        __m128i hi = _mm_shuffle_epi8(table16, _mm_and_si128(_mm_srli_epi16(b, 4), mask16));
+        __m128i lo = _mm_shuffle_epi8(table16, _mm_and_si128(b, mask16));
+        _mm_storeu_si128((__m128i *)(hex + i * 2), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *)(hex + i * 2 + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    return i;
+}
+#endif
+
+std::string hex_to_bytes(const std::string &hex) {
+    std::string bytes(hex.length() / 2, 0);
+    const char *in = hex.data();
+    char *out = &bytes[0];
+    size_t i = 0, n = bytes.length();
+#if defined(DUPTREE_X86)
+    if (cpu().ssse3)
+        i = hex_to_bytes_ssse3(in, out, n);
+#endif
+    for (; i < n; ++i) {
+        out[i] = char((hex_value(in[i * 2]) << 4) | hex_value(in[i * 2 + 1]));
+    }
+    return bytes;
+}
+
+void bytes_to_hex(const char *bytes, size_t len, char *hex, bool upper) {
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    size_t i = 0;
+#if defined(DUPTREE_X86)
+    const char a = upper ? 'A' : 'a';
+    if (cpu().avx2)
+        i = bytes_to_hex_avx2(bytes, i, len, hex, a);
+    if (cpu().ssse3)
+        i = bytes_to_hex_ssse3(bytes, i, len, hex, a);
+#endif
+    for (; i < len; ++i) {
+        auto c = (unsigned char)bytes[i];
+        hex[i * 2] = digits[c >> 4];
+        hex[i * 2 + 1] = digits[c & 15];
+    }
+}
+
+std::string bytes_to_hex(const char *bytes, size_t len) {
+    std::string hex(len * 2, 0);
+    bytes_to_hex(bytes, len, &hex[0]);
+    return hex;
+}
+
 bool is_prefix(const std::string &str, const std::string &pre) {
     return str.compare(0, pre.size(), pre) == 0;
 }
 
-std::string common_prefix(const std::string &s1, const std::string &s2) {
-    std::string result;
-    int len = std::min(s1.length(), s2.length());
+size_t common_prefix_length(const std::string &s1, const std::string &s2) {
+    size_t len = std::min(s1.length(), s2.length()), i = 0;
 
-    // Compare str1 and str2
-    for (int i = 0; i < len; i++) {
-        if (s1[i] != s2[i])
-            break;
-        result += s1[i];
+    // Compare 8 characters at a time, the first differing byte ends the prefix
+    for (; i + 8 <= len; i += 8) {
+        uint64_t a, b;
+        std::memcpy(&a, s1.data() + i, 8);
+        std::memcpy(&b, s2.data() + i, 8);
+        if (a != b) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            return i + (__builtin_ctzll(a ^ b) >> 3);
+#else
+            return i + (__builtin_clzll(a ^ b) >> 3);
+#endif
+        }
     }
+    for (; i < len && s1[i] == s2[i]; ++i);
+    return i;
+}
 
-    return (result);
-}
\ No newline at end of file
+std::string common_prefix(const std::string &s1, const std::string &s2) {
+    return s1.substr(0, common_prefix_length(s1, s2));
+}
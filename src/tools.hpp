@@ -4,10 +4,13 @@
 #include <string>
 #include <vector>
 #include <cstring>
+#include <cstdint>
 #include <cmath>
 #include <ios>
 #include <sstream>
 #include <map>
+#include <array>
+#include <random>
 
 typedef long long Int;
 inline std::string itos(Int decimal) {
@@ -36,7 +39,18 @@ inline std::string itos(Int decimal) {
 }
 
 std::string calculateSHA256Hash(const std::string& data);
+// SHA-256 of len bytes into out[32], through EVP.
+void sha256(const char *data, size_t len, unsigned char *out);
+// SHA-256 of eight messages of the same length into out[i * 32]; on a CPU with
+// AVX2 and without the SHA extensions each message takes one 32-bit lane,
+// otherwise they are hashed one by one.
+void sha256_x8(const char *const data[8], size_t len, unsigned char *out);
+// CRC-32C (Castagnoli) of len bytes continuing from crc, with SSE4.2 if the
+// CPU has it.
+uint32_t crc32c(const char *data, size_t len, uint32_t crc = 0);
 std::string random_string(Int len = 64);
+// 64 hex characters from 32 bytes of rng, a stand-in leaf digest without hashing.
+std::string random_digest(std::mt19937_64 &rng);
 
 Int up_to(Int x, Int v);
 Int up_to_max(Int x, Int v);
@@ -46,10 +60,31 @@ std::string hex_to_binary(const std::string &hex);
 std::string int_to_binary(Int decimal, Int numBits);
 std::string int_to_hex(Int decimal, Int numBits);
 std::string int_to_hex(Int decimal);
+std::string hex_to_bytes(const std::string &hex);
+std::string bytes_to_hex(const char *bytes, size_t len);
+void bytes_to_hex(const char *bytes, size_t len, char *hex, bool upper = false);
 
-extern std::map<char, int> hti;
+// Nibble value of each character; 0x10 marks a non-hex character.
+constexpr std::array<unsigned char, 256> make_hex_table() {
+    std::array<unsigned char, 256> t{};
+    for (int c = 0; c < 256; ++c) {
+        t[c] = c >= '0' && c <= '9' ? c - '0' :
+               c >= 'A' && c <= 'F' ? c - 'A' + 10 :
+               c >= 'a' && c <= 'f' ? c - 'a' + 10 : 0x10;
+    }
+    return t;
+}
+inline constexpr std::array<unsigned char, 256> hex_table = make_hex_table();
+
+inline int hex_value(char c) {
+    return hex_table[(unsigned char)c] & 15;
+}
+inline bool is_hex(char c) {
+    return hex_table[(unsigned char)c] < 16;
+}
 extern std::string null64;
 bool is_prefix(const std::string &str, const std::string &pre);
+size_t common_prefix_length(const std::string &s1, const std::string &s2);
 std::string common_prefix(const std::string &s1, const std::string &s2);
 
 #endif //DUPTREE_TOOLS_HPP
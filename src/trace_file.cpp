@@ -0,0 +1,212 @@
+#include "trace_file.hpp"
+#include "replay.hpp"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+    const char MAGIC[8] = {'D', 'U', 'P', 'T', 'R', 'A', 'C', 'E'};
+    const size_t INDEX_ENTRY = 16;
+
+    void put_le(std::string &out, uint64_t v, int bytes) {
+        for (int i = 0; i < bytes; ++i) {
+            out.push_back(char(v >> (i * 8)));
+        }
+    }
+
+    uint64_t get_le(const char *p, int bytes) {
+        uint64_t v = 0;
+        for (int i = 0; i < bytes; ++i) {
+            v |= uint64_t((unsigned char)p[i]) << (i * 8);
+        }
+        return v;
+    }
+}
+
+void TraceFile::Op::key_hex(std::string &out) const {
+    out.resize(KEY_BYTES * 2);
+    bytes_to_hex(key, KEY_BYTES, &out[0], true);
+}
+
+std::string TraceFile::Op::key_hex() const {
+    std::string out;
+    key_hex(out);
+    return out;
+}
+
+bool TraceFile::Cursor::next(Op &op) {
+    if (p >= end) {
+        return false;
+    }
+    if ((*p != 'r' && *p != 'w') || (size_t)(end - p) < 1 + KEY_BYTES) {
+        throw std::invalid_argument("corrupt trace record");
+    }
+    op.type = *p;
+    op.key = p + 1;
+    p += 1 + KEY_BYTES;
+    op.value = p;
+    op.value_len = 0;
+    if (op.type == 'w') {
+        size_t len = 0;
+        for (int shift = 0; ; shift += 7) {
+            if (p >= end || shift > 63) {
+                throw std::invalid_argument("corrupt trace record");
+            }
+            auto c = (unsigned char)*p++;
+            len |= size_t(c & 0x7f) << shift;
+            if ((c & 0x80) == 0) {
+                break;
+            }
+        }
+        if ((size_t)(end - p) < len) {
+            throw std::invalid_argument("corrupt trace record");
+        }
+        op.value = p;
+        op.value_len = len;
+        p += len;
+    }
+    return true;
+}
+
+TraceFile::TraceFile(std::string path) : path(std::move(path)) {}
+
+bool TraceFile::open() {
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < HEADER_SIZE) {
+        close();
+        return false;
+    }
+    size = st.st_size;
+    void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+        close();
+        return false;
+    }
+    data = (const char *)p;
+
+    if (std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0 || get_le(data + 8, 4) != VERSION) {
+        close();
+        throw std::invalid_argument("unsupported trace file: " + path);
+    }
+    flags = (uint32_t)get_le(data + 12, 4);
+    blocks = (Int)get_le(data + 16, 8);
+    ops = (Int)get_le(data + 24, 8);
+    uint64_t index_offset = get_le(data + 32, 8);
+    if (index_offset < HEADER_SIZE || index_offset > size || (size - index_offset) / INDEX_ENTRY != (uint64_t)blocks) {
+        close();
+        throw std::invalid_argument("corrupt trace index: " + path);
+    }
+    index = data + index_offset;
+    madvise((void *)data, size, MADV_SEQUENTIAL);
+    return true;
+}
+
+uint64_t TraceFile::block_offset(Int i) const {
+    return i < blocks ? get_le(index + i * INDEX_ENTRY, 8) : (uint64_t)(index - data);
+}
+
+TraceFile::Block TraceFile::block(Int i) const {
+    if (i < 0 || i >= blocks) {
+        throw std::out_of_range("trace block out of range");
+    }
+    uint64_t begin = block_offset(i), end = block_offset(i + 1);
+    if (begin < HEADER_SIZE || begin > end || end > (uint64_t)(index - data)) {
+        throw std::invalid_argument("corrupt trace index: " + path);
+    }
+    bool committed = i + 1 < blocks || (flags & OPEN_TAIL) == 0;
+    Int n = (Int)get_le(index + i * INDEX_ENTRY + 8, 8);
+    return Block{i, committed, n, Cursor(data + begin, data + end)};
+}
+
+Int TraceFile::count_ops(Int first, Int last) const {
+    Int n = 0;
+    for (Int i = first < 0 ? 0 : first; i < last && i < blocks; ++i) {
+        n += (Int)get_le(index + i * INDEX_ENTRY + 8, 8);
+    }
+    return n;
+}
+
+void TraceFile::close() {
+    if (data != nullptr) {
+        munmap((void *)data, size);
+        data = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    index = nullptr;
+    blocks = ops = 0;
+}
+
+TraceFile::~TraceFile() {
+    close();
+}
+
+bool compile_trace(const std::string &text_path, const std::string &bin_path, int threads) {
+    TraceReplay replay(text_path, threads, 64, false);
+    if (!replay.open()) {
+        return false;
+    }
+    std::ofstream out(bin_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    out.write(std::string(TraceFile::HEADER_SIZE, 0).data(), TraceFile::HEADER_SIZE);
+
+    std::string index, buf;
+    uint64_t offset = TraceFile::HEADER_SIZE;
+    Int blocks = 0, ops = 0;
+    uint32_t flags = 0;
+    TraceBlock block;
+    while (replay.next(block)) {
+        if (!block.committed) {
+            flags |= TraceFile::OPEN_TAIL;
+        }
+        put_le(index, offset, 8);
+        put_le(index, block.ops.size(), 8);
+        buf.clear();
+        for (const auto &op : block.ops) {
+            buf.push_back(op.type);
+            buf.append(hex_to_bytes(op.key));
+            if (op.type == 'w') {
+                size_t len = op.value.length();
+                while (len >= 0x80) {
+                    buf.push_back(char((len & 0x7f) | 0x80));
+                    len >>= 7;
+                }
+                buf.push_back(char(len));
+                buf.append(op.value);
+            }
+        }
+        out.write(buf.data(), (std::streamsize)buf.length());
+        offset += buf.length();
+        ops += (Int)block.ops.size();
+        ++blocks;
+    }
+    out.write(index.data(), (std::streamsize)index.length());
+
+    std::string header(MAGIC, sizeof(MAGIC));
+    put_le(header, TraceFile::VERSION, 4);
+    put_le(header, flags, 4);
+    put_le(header, blocks, 8);
+    put_le(header, ops, 8);
+    put_le(header, offset, 8);
+    put_le(header, TraceFile::HEADER_SIZE, 8);
+    out.seekp(0);
+    out.write(header.data(), (std::streamsize)header.length());
+    out.close();
+    if (!out) {
+        throw std::runtime_error("write trace error: " + bin_path);
+    }
+    return true;
+}
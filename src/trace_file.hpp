@@ -0,0 +1,86 @@
+#ifndef DUPTREE_TRACE_FILE_HPP
+#define DUPTREE_TRACE_FILE_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "tools.hpp"
+
+// Pre-compiled eth trace, produced from an ethXX.txt by compile_trace().
+//
+//   header: "DUPTRACE" [version u32][flags u32][blocks u64][ops u64][index offset u64][data offset u64]
+//   ops:    'r' [key 20] | 'w' [key 20][varint length][value]
+//   index:  per block [offset u64][ops u64]
+//
+// Integers are little-endian. Block i is the i-th block of the text trace, so
+// its number is i; every block is committed except a trailing one flagged with
+// OPEN_TAIL. Values are the raw trace values, the reader composes nothing.
+class TraceFile {
+public:
+    static const uint32_t VERSION = 1;
+    static const uint32_t OPEN_TAIL = 1;
+    static const size_t KEY_BYTES = 20;
+    static const size_t HEADER_SIZE = 48;
+
+    struct Op {
+        char type; // 'r' or 'w'
+        const char *key; // KEY_BYTES packed bytes
+        const char *value; // raw value, value_len bytes, empty for reads
+        size_t value_len;
+
+        std::string key_hex() const;
+        void key_hex(std::string &out) const;
+    };
+
+    // Iterates the ops of one block straight out of the mapping.
+    class Cursor {
+        const char *p, *end;
+
+    public:
+        Cursor(const char *p, const char *end) : p(p), end(end) {}
+        bool next(Op &op);
+    };
+
+    struct Block {
+        Int number;
+        bool committed;
+        Int num_ops;
+        Cursor ops;
+    };
+
+private:
+    std::string path;
+    int fd = -1;
+    const char *data = nullptr;
+    size_t size = 0;
+
+    uint32_t flags = 0;
+    Int blocks = 0, ops = 0;
+    const char *index = nullptr;
+
+    uint64_t block_offset(Int i) const;
+
+public:
+    explicit TraceFile(std::string path);
+
+    bool open();
+    void close();
+
+    Int num_blocks() const {
+        return blocks;
+    }
+    Int num_ops() const {
+        return ops;
+    }
+    Block block(Int i) const;
+    // Total ops in blocks [first, last), from the index alone.
+    Int count_ops(Int first, Int last) const;
+
+    ~TraceFile();
+};
+
+// Compiles a text trace into the binary format, parsing it with TraceReplay.
+// Returns false if either file cannot be opened.
+bool compile_trace(const std::string &text_path, const std::string &bin_path, int threads = 0);
+
+#endif //DUPTREE_TRACE_FILE_HPP
@@ -0,0 +1,204 @@
+#include "update_log.hpp"
+#include <cerrno>
+#include <cstring>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace {
+    const size_t RECORD_HEADER = 12;
+
+    void put_u32(std::string &out, uint32_t v) {
+        for (int i = 0; i < 4; ++i) {
+            out.push_back(char(v >> (i * 8)));
+        }
+    }
+
+    uint32_t get_u32(const char *p) {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) {
+            v |= uint32_t((unsigned char)p[i]) << (i * 8);
+        }
+        return v;
+    }
+
+    bool read_file(const std::string &path, std::string &out) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st{};
+        fstat(fd, &st);
+        out.resize(st.st_size);
+        size_t done = 0;
+        while (done < out.size()) {
+            ssize_t n = ::read(fd, &out[done], out.size() - done);
+            if (n <= 0) {
+                break;
+            }
+            done += n;
+        }
+        out.resize(done);
+        ::close(fd);
+        return true;
+    }
+}
+
+UpdateLog::UpdateLog(std::string path) : path(std::move(path)) {}
+
+std::string UpdateLog::segment_path(Int s) const {
+    return path + "." + std::to_string(s);
+}
+
+std::string UpdateLog::directory() const {
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? "." : path.substr(0, slash + 1);
+}
+
+bool UpdateLog::sync_directory() const {
+    int dfd = ::open(directory().c_str(), O_RDONLY | O_DIRECTORY);
+    if (dfd < 0) {
+        return false;
+    }
+    bool ok = fsync(dfd) == 0;
+    ::close(dfd);
+    return ok;
+}
+
+// A synced record is only durable once the directory holds its segment.
+bool UpdateLog::open_segment(Int s) {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    fd = ::open(segment_path(s).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    last = s;
+    return fd >= 0 && sync_directory();
+}
+
+bool UpdateLog::open(bool create) {
+    close();
+    std::string dir = directory(), base = path.substr(path.rfind('/') + 1);
+    first = 1;
+    last = 0;
+    Int lo = 0;
+    if (DIR *d = opendir(dir.c_str())) {
+        while (dirent *e = readdir(d)) {
+            std::string name(e->d_name);
+            if (name.length() <= base.length() + 1 || name.compare(0, base.length() + 1, base + ".") != 0
+                    || name.find_first_not_of("0123456789", base.length() + 1) != std::string::npos) {
+                continue;
+            }
+            Int s = std::stoll(name.substr(base.length() + 1));
+            lo = lo == 0 ? s : std::min(lo, s);
+            last = std::max(last, s);
+        }
+        closedir(d);
+    }
+    if (last > 0) {
+        first = lo;
+    }
+    if (create) {
+        drop(last);
+    }
+    // the last segment may end in a torn record; replay stops there and
+    // appends go to a fresh segment
+    return open_segment(last + 1);
+}
+
+void UpdateLog::close() {
+    if (fd >= 0) {
+        sync();
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+void UpdateLog::append(const std::string &key, const std::string &value) {
+    size_t start = buffer.size();
+    put_u32(buffer, 0);
+    put_u32(buffer, (uint32_t)key.length());
+    put_u32(buffer, (uint32_t)value.length());
+    buffer.append(key).append(value);
+    uint32_t crc = crc32c(&buffer[start + 4], buffer.size() - start - 4);
+    for (int i = 0; i < 4; ++i) {
+        buffer[start + i] = char(crc >> (i * 8));
+    }
+}
+
+bool UpdateLog::sync() {
+    if (buffer.empty()) {
+        return true;
+    }
+    if (fd < 0) {
+        return false;
+    }
+    size_t done = 0;
+    while (done < buffer.size()) {
+        ssize_t n = ::write(fd, buffer.data() + done, buffer.size() - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            // the rest goes after what did reach the file at the next try
+            buffer.erase(0, done);
+            return false;
+        }
+        done += n;
+    }
+    buffer.clear();
+    return fdatasync(fd) == 0;
+}
+
+Int UpdateLog::replay(const std::function<void(const std::string &, const std::string &)> &apply) {
+    Int n = 0;
+    std::string data, key, value;
+    for (Int s = first; s <= last; ++s) {
+        if (!read_file(segment_path(s), data)) {
+            continue;
+        }
+        for (size_t p = 0; p + RECORD_HEADER <= data.size(); ) {
+            uint32_t crc = get_u32(&data[p]);
+            size_t klen = get_u32(&data[p + 4]), vlen = get_u32(&data[p + 8]);
+            if (data.size() - p - RECORD_HEADER < klen + vlen
+                    || crc32c(&data[p + 4], RECORD_HEADER - 4 + klen + vlen) != crc) {
+                break;
+            }
+            key.assign(&data[p + RECORD_HEADER], klen);
+            value.assign(&data[p + RECORD_HEADER + klen], vlen);
+            apply(key, value);
+            ++n;
+            p += RECORD_HEADER + klen + vlen;
+        }
+    }
+    return n;
+}
+
+Int UpdateLog::roll() {
+    if (!sync()) {
+        return 0;
+    }
+    Int s = last;
+    return open_segment(last + 1) ? s : 0;
+}
+
+void UpdateLog::drop(Int s) {
+    if (first > s) {
+        return;
+    }
+    for (; first <= s; ++first) {
+        ::unlink(segment_path(first).c_str());
+    }
+    sync_directory();
+}
+
+void UpdateLog::destroy() {
+    open(true);
+    close();
+    drop(last);
+}
+
+UpdateLog::~UpdateLog() {
+    close();
+}
@@ -0,0 +1,180 @@
+#ifndef DUPTREE_UPDATE_LOG_HPP
+#define DUPTREE_UPDATE_LOG_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <functional>
+#include <stdexcept>
+#include "mem_checker.hpp"
+
+// Append-only log of logical updates, in numbered segment files path.1,
+// path.2, ... so that the records a checkpoint covers can be deleted while
+// new ones are appended.
+//
+//   record: [crc u32][key length u32][value length u32][key][value]
+//
+// Integers are little-endian; the CRC-32C covers both lengths, key and value.
+// A record cut short or failing its CRC ends replay, which is what a crash
+// while appending leaves at the tail.
+class UpdateLog {
+    std::string path;
+    int fd = -1;
+    Int first = 1, last = 0; // segments on disk, last is appended to
+    std::string buffer; // records not written yet
+
+    std::string segment_path(Int s) const;
+    std::string directory() const;
+    // Syncs the directory, so that segments created or deleted stay so.
+    bool sync_directory() const;
+    bool open_segment(Int s);
+
+public:
+    explicit UpdateLog(std::string path);
+
+    // Finds the segments on disk and appends to a new one; create deletes
+    // the old ones first.
+    bool open(bool create);
+    void close();
+
+    void append(const std::string &key, const std::string &value);
+    // Writes the records appended so far and syncs them, one sync for the
+    // group. False if they may not be on disk; records a short write left
+    // behind are kept for the next call.
+    bool sync();
+    // Calls apply for every record on disk, oldest first; returns how many.
+    Int replay(const std::function<void(const std::string &, const std::string &)> &apply);
+
+    // Appends to a new segment; returns the one before, which holds every
+    // record so far, or 0 if they could not be synced or no segment opened.
+    Int roll();
+    // Deletes segments up to s.
+    void drop(Int s);
+    void destroy();
+
+    ~UpdateLog();
+};
+
+// Makes the updates of a checker durable through an UpdateLog rather than by
+// syncing io (which should then run with sync=0): an update is logged before
+// it is applied, every group updates share one sync of the log, and commit()
+// syncs what is left. Each checkpoint_every commits a background thread syncs
+// io, and the log segments that checkpoint covers are deleted when it is done
+// if the sync succeeded; otherwise they wait for the next checkpoint.
+// init(io, false) replays the log over the commit io recovers. A log that
+// cannot be written or synced makes update() and commit() throw
+// std::runtime_error.
+class LoggedChecker : public MemChecker {
+    std::unique_ptr<MemChecker> inner;
+    UpdateLog log;
+    Int group, checkpoint_every;
+    Int unsynced = 0, commits = 0;
+    std::thread checkpointer;
+    Int covered = 0; // last segment of the running checkpoint
+    bool synced = false; // the running checkpoint's sync of io succeeded
+
+    void sync_log() {
+        if (!log.sync()) {
+            throw std::runtime_error("cannot write update log");
+        }
+        unsynced = 0;
+    }
+
+    void logged(Int n) {
+        unsynced += n;
+        if (group > 0 && unsynced >= group) {
+            sync_log();
+        }
+    }
+
+    Int roll_log() {
+        Int s = log.roll();
+        if (s == 0) {
+            throw std::runtime_error("cannot roll update log");
+        }
+        return s;
+    }
+
+    void finish_checkpoint() {
+        if (checkpointer.joinable()) {
+            checkpointer.join();
+            if (synced) {
+                log.drop(covered);
+            }
+        }
+    }
+
+    void checkpoint() {
+        finish_checkpoint();
+        covered = roll_log();
+        IO *target = io;
+        synced = false;
+        checkpointer = std::thread([this, target] { synced = target->sync(); });
+    }
+
+public:
+    LoggedChecker(MemChecker *inner, const std::string &path, Int group, Int checkpoint_every)
+            : inner(inner), log(path), group(group), checkpoint_every(checkpoint_every) {}
+
+    bool init(IO *io, bool create_db, std::string *values) override {
+        finish_checkpoint();
+        this->io = io;
+        if (!inner->init(io, create_db, values) || !log.open(create_db)) {
+            return false;
+        }
+        if (!create_db && log.replay([&](const std::string &k, const std::string &v) { inner->update(k, v); }) > 0) {
+            inner->commit();
+        }
+        Int s = roll_log();
+        if (io->sync()) {
+            log.drop(s);
+        }
+        unsynced = commits = 0;
+        return true;
+    }
+    void update(const std::string &spos, const std::string &value) override {
+        log.append(spos, value);
+        inner->update(spos, value);
+        logged(1);
+    }
+    void update_batch(const std::vector<std::pair<std::string, std::string>> &updates) override {
+        for (const auto &u : updates) {
+            log.append(u.first, u.second);
+        }
+        inner->update_batch(updates);
+        logged((Int)updates.size());
+    }
+    std::pair<Int, Int> commit() override {
+        auto c = inner->commit();
+        sync_log();
+        if (checkpoint_every > 0 && ++commits % checkpoint_every == 0) {
+            checkpoint();
+        }
+        return c;
+    }
+    std::string gen_proof(const std::string &spos) override {
+        return inner->gen_proof(spos);
+    }
+    bool verify_proof(const std::string &spos, const std::string &value, const std::string &proof) override {
+        return inner->verify_proof(spos, value, proof);
+    }
+    std::string get_name() override {
+        return inner->get_name();
+    }
+    std::string get_digest() override {
+        return inner->get_digest();
+    }
+    verifier::Family proof_family() override {
+        return inner->proof_family();
+    }
+    bool walk(const Visit &visit) override {
+        return inner->walk(visit);
+    }
+
+    ~LoggedChecker() override {
+        finish_checkpoint();
+    }
+};
+
+#endif //DUPTREE_UPDATE_LOG_HPP
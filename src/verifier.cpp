@@ -0,0 +1,377 @@
+#include "verifier.hpp"
+#include "tools.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+namespace verifier {
+    namespace {
+        const size_t DIGEST = 32, HEX_DIGEST = 64;
+
+        class Reader {
+            const unsigned char *p, *end;
+
+        public:
+            Reader(const std::string &s) : p((const unsigned char *)s.data()), end(p + s.length()) {}
+
+            bool left(size_t n) const {
+                return (size_t)(end - p) >= n;
+            }
+            bool byte(unsigned &out) {
+                if (!left(1))
+                    return false;
+                out = *p++;
+                return true;
+            }
+            bool varint(uint64_t &out) {
+                out = 0;
+                for (int shift = 0; shift < 64 && left(1); shift += 7) {
+                    unsigned char c = *p++;
+                    out |= uint64_t(c & 0x7f) << shift;
+                    if ((c & 0x80) == 0)
+                        return true;
+                }
+                return false;
+            }
+            const char *take(size_t n) {
+                if (!left(n))
+                    return nullptr;
+                const char *r = (const char *)p;
+                p += n;
+                return r;
+            }
+            size_t offset(const std::string &s) const {
+                return (const char *)p - s.data();
+            }
+        };
+
+        // SHA-256 of the hex text, as calculateSHA256Hash(), kept as hex
+        void hash_hex(const char *text, size_t len, char out[HEX_DIGEST]) {
+            unsigned char d[DIGEST];
+            sha256(text, len, d);
+            bytes_to_hex((const char *)d, DIGEST, out);
+        }
+
+        void put_varint(std::string &out, uint64_t v) {
+            while (v >= 0x80) {
+                out.push_back(char((v & 0x7f) | 0x80));
+                v >>= 7;
+            }
+            out.push_back(char(v));
+        }
+
+        void check(bool ok) {
+            if (!ok)
+                throw std::invalid_argument("malformed proof");
+        }
+
+        struct Header {
+            unsigned family;
+            uint64_t steps;
+            long long pos; // MERKLE: the leaf position, which picks the sides
+        };
+
+        // Fills at[] with the offsets of the steps, leaf first; false if the
+        // proof does not parse.
+        bool parse(const std::string &key, const std::string &value, const std::string &proof, Header &h, uint32_t *at) {
+            Reader in(proof);
+            unsigned flags;
+            if (!in.byte(h.family) || !in.byte(flags) || !in.varint(h.steps) || h.steps > MAX_STEPS)
+                return false;
+            // an ABSENT proof carries no path, so nothing ties it to the root
+            if ((flags & ABSENT) != 0)
+                return false;
+            if (h.family == MERKLE) {
+                if (value.length() != HEX_DIGEST || h.steps >= 63 || key.empty())
+                    return false;
+                char *end;
+                h.pos = std::strtoll(key.c_str(), &end, 10);
+                if (*end != 0 || h.pos < 0 || h.pos >= (1LL << h.steps))
+                    return false;
+            } else if (h.family != SPARSE && h.family != HEX) {
+                return false;
+            }
+            for (uint64_t i = 0; i < h.steps; ++i) {
+                at[i] = (uint32_t)in.offset(proof);
+                if (h.family == MERKLE) {
+                    if (in.take(DIGEST) == nullptr)
+                        return false;
+                } else if (h.family == SPARSE) {
+                    unsigned bits;
+                    if (!in.byte(bits) || ((bits & 2) != 0 && in.take(DIGEST) == nullptr))
+                        return false;
+                } else {
+                    unsigned which, lo, hi;
+                    if (!in.byte(which) || !in.byte(lo) || !in.byte(hi) || which >= 16)
+                        return false;
+                    unsigned present = lo | hi << 8;
+                    if ((present >> which & 1) != 0 || in.take(DIGEST * __builtin_popcount(present)) == nullptr)
+                        return false;
+                }
+            }
+            // SPARSE and HEX steps are sent root to leaf
+            if (h.family != MERKLE)
+                std::reverse(at, at + h.steps);
+            return !in.left(1) && proof.length() <= UINT32_MAX;
+        }
+
+        // The leaf digest the first step hashes.
+        void leaf(const Header &h, const std::string &value, char cur[HEX_DIGEST]) {
+            if (h.family == MERKLE)
+                std::memcpy(cur, value.data(), HEX_DIGEST);
+            else
+                hash_hex(value.data(), value.length(), cur);
+        }
+
+        // Writes the hash input of step i (0 at the leaf) to buf, at most
+        // HEX_DIGEST * 16 bytes, and returns its length.
+        size_t step_input(const Header &h, const std::string &proof, const uint32_t *at, uint64_t i,
+                          const char cur[HEX_DIGEST], char *buf) {
+            const char *p = proof.data() + at[i];
+            if (h.family == MERKLE) {
+                bool right = ((h.pos + (1LL << h.steps)) >> i & 1) != 0;
+                std::memcpy(buf + (right ? HEX_DIGEST : 0), cur, HEX_DIGEST);
+                bytes_to_hex(p, DIGEST, buf + (right ? 0 : HEX_DIGEST));
+                return HEX_DIGEST * 2;
+            }
+            if (h.family == SPARSE) {
+                auto bits = (unsigned char)p[0];
+                size_t len = (bits & 2) != 0 ? HEX_DIGEST : 0;
+                if ((bits & 1) == 0) {
+                    std::memcpy(buf, cur, HEX_DIGEST);
+                    if (len > 0)
+                        bytes_to_hex(p + 1, DIGEST, buf + HEX_DIGEST);
+                } else {
+                    if (len > 0)
+                        bytes_to_hex(p + 1, DIGEST, buf);
+                    std::memcpy(buf + len, cur, HEX_DIGEST);
+                }
+                return HEX_DIGEST + len;
+            }
+            unsigned which = (unsigned char)p[0];
+            unsigned present = (unsigned char)p[1] | (unsigned char)p[2] << 8;
+            const char *sibling = p + 3;
+            size_t len = 0;
+            for (unsigned j = 0; j < 16; ++j) {
+                if (j == which) {
+                    std::memcpy(buf + len, cur, HEX_DIGEST);
+                    len += HEX_DIGEST;
+                } else if ((present >> j & 1) != 0) {
+                    bytes_to_hex(sibling, DIGEST, buf + len);
+                    sibling += DIGEST;
+                    len += HEX_DIGEST;
+                }
+            }
+            return len;
+        }
+
+        // SHA-256 of n texts of one length, as hex, eight at a time through
+        // sha256_x8.
+        void hash_many(const char *const *texts, size_t n, size_t len, char *const *out) {
+            size_t i = 0;
+            unsigned char d[DIGEST * 8];
+            for (; i + 8 <= n; i += 8) {
+                sha256_x8(texts + i, len, d);
+                for (int l = 0; l < 8; ++l)
+                    bytes_to_hex((const char *)d + l * DIGEST, DIGEST, out[i + l]);
+            }
+            for (; i < n; ++i)
+                hash_hex(texts[i], len, out[i]);
+        }
+
+        // The bytes of step i, which with the digest below it and (MERKLE)
+        // the side make up the hash input.
+        size_t step_size(const Header &h, const char *p) {
+            if (h.family == MERKLE)
+                return DIGEST;
+            if (h.family == SPARSE)
+                return (p[0] & 2) != 0 ? 1 + DIGEST : 1;
+            return 3 + DIGEST * __builtin_popcount((unsigned char)p[1] | (unsigned char)p[2] << 8);
+        }
+
+        // Verifies proofs[order[first, last)]. All proofs climb together, one
+        // level per round. order sorts keys, so proofs that meet at a node sit
+        // next to each other and, holding the same digest there, carry the same
+        // input up to the root: a round hashes it once for the whole run.
+        void verify_range(const std::string &root, const std::vector<std::string> &keys,
+                          const std::vector<std::string> &values, const std::vector<std::string> &proofs,
+                          const std::vector<size_t> &order, size_t first, size_t last, std::vector<uint8_t> &ok) {
+            struct Climb {
+                size_t idx;
+                Header h;
+                size_t at; // into offsets
+                size_t input; // this round's distinct input
+                char cur[HEX_DIGEST];
+            };
+            std::vector<Climb> climbs;
+            std::vector<uint32_t> offsets;
+            uint32_t at[MAX_STEPS];
+            uint64_t rounds = 0;
+            for (size_t k = first; k < last; ++k) {
+                size_t idx = order[k];
+                Climb c;
+                c.idx = idx;
+                if (!parse(keys[idx], values[idx], proofs[idx], c.h, at)) {
+                    ok[idx] = 0;
+                    continue;
+                }
+                leaf(c.h, values[idx], c.cur);
+                c.at = offsets.size();
+                offsets.insert(offsets.end(), at, at + c.h.steps);
+                rounds = std::max(rounds, c.h.steps);
+                climbs.push_back(c);
+            }
+
+            std::string arena;
+            std::vector<size_t> start, length;
+            std::vector<size_t> by_length[17]; // inputs of 64 * n bytes
+            std::vector<const char *> texts;
+            std::vector<char *> outs;
+            std::string digests;
+            // round r takes the step r levels below the root of every proof that deep
+            for (uint64_t r = rounds; r >= 1; --r) {
+                arena.clear();
+                start.clear();
+                length.clear();
+                const Climb *prev = nullptr;
+                const char *prev_step = nullptr;
+                for (Climb &c : climbs) {
+                    if (c.h.steps < r)
+                        continue;
+                    uint64_t i = c.h.steps - r;
+                    const char *p = proofs[c.idx].data() + offsets[c.at + i];
+                    size_t size = step_size(c.h, p);
+                    if (prev != nullptr && prev->h.family == c.h.family && step_size(prev->h, prev_step) == size &&
+                        std::memcmp(prev_step, p, size) == 0 && std::memcmp(prev->cur, c.cur, HEX_DIGEST) == 0 &&
+                        (c.h.family != MERKLE || ((prev->h.pos + (1LL << prev->h.steps)) >> (prev->h.steps - r) & 1) ==
+                                                 ((c.h.pos + (1LL << c.h.steps)) >> i & 1))) {
+                        c.input = prev->input;
+                    } else {
+                        char buf[HEX_DIGEST * 16];
+                        size_t len = step_input(c.h, proofs[c.idx], offsets.data() + c.at, i, c.cur, buf);
+                        c.input = start.size();
+                        start.push_back(arena.size());
+                        length.push_back(len);
+                        arena.append(buf, len);
+                    }
+                    prev = &c;
+                    prev_step = p;
+                }
+
+                digests.resize(start.size() * HEX_DIGEST);
+                for (auto &b : by_length)
+                    b.clear();
+                for (size_t u = 0; u < start.size(); ++u)
+                    by_length[length[u] / HEX_DIGEST].push_back(u);
+                for (size_t n = 1; n <= 16; ++n) {
+                    texts.clear();
+                    outs.clear();
+                    for (size_t u : by_length[n]) {
+                        texts.push_back(arena.data() + start[u]);
+                        outs.push_back(&digests[u * HEX_DIGEST]);
+                    }
+                    hash_many(texts.data(), texts.size(), n * HEX_DIGEST, outs.data());
+                }
+                for (Climb &c : climbs) {
+                    if (c.h.steps >= r)
+                        std::memcpy(c.cur, digests.data() + c.input * HEX_DIGEST, HEX_DIGEST);
+                }
+            }
+            for (const Climb &c : climbs) {
+                ok[c.idx] = root.length() == HEX_DIGEST && std::memcmp(c.cur, root.data(), HEX_DIGEST) == 0;
+            }
+        }
+    }
+
+    std::string encode_proof(Family family, const std::string &proof) {
+        std::string out;
+        out.push_back(char(family));
+        // only a lone '?': a hex step down child 15 also starts with '0' + 15
+        if (proof == "?") {
+            out.push_back(char(ABSENT));
+            put_varint(out, 0);
+            return out;
+        }
+        out.push_back(0);
+        size_t stride = family == MERKLE ? HEX_DIGEST : family == SPARSE ? 1 + HEX_DIGEST : 1 + HEX_DIGEST * 15;
+        check(family <= HEX && proof.length() % stride == 0 && proof.length() / stride <= MAX_STEPS);
+        put_varint(out, proof.length() / stride);
+        for (size_t i = 0; i < proof.length(); i += stride) {
+            if (family == MERKLE) {
+                out.append(hex_to_bytes(proof.substr(i, HEX_DIGEST)));
+            } else if (family == SPARSE) {
+                check(proof[i] == '0' || proof[i] == '1');
+                bool present = proof[i + 1] != null64[0];
+                out.push_back(char((proof[i] == '1' ? 1 : 0) | (present ? 2 : 0)));
+                if (present)
+                    out.append(hex_to_bytes(proof.substr(i + 1, HEX_DIGEST)));
+            } else {
+                int which = proof[i] - '0';
+                check(which >= 0 && which < 16);
+                unsigned present = 0;
+                std::string siblings;
+                for (int j = 0, k = 0; j < 16; ++j) {
+                    if (j == which)
+                        continue;
+                    size_t pos = i + 1 + HEX_DIGEST * k++;
+                    if (proof[pos] != null64[0]) {
+                        present |= 1u << j;
+                        siblings.append(hex_to_bytes(proof.substr(pos, HEX_DIGEST)));
+                    }
+                }
+                out.push_back(char(which));
+                out.push_back(char(present & 0xff));
+                out.push_back(char(present >> 8));
+                out.append(siblings);
+            }
+        }
+        return out;
+    }
+
+    bool verify(const std::string &root, const std::string &key, const std::string &value, const std::string &proof) {
+        Header h;
+        uint32_t at[MAX_STEPS];
+        if (!parse(key, value, proof, h, at))
+            return false;
+        char cur[HEX_DIGEST], buf[HEX_DIGEST * 16];
+        leaf(h, value, cur);
+        for (uint64_t i = 0; i < h.steps; ++i)
+            hash_hex(buf, step_input(h, proof, at, i, cur, buf), cur);
+        return root.length() == HEX_DIGEST && std::memcmp(cur, root.data(), HEX_DIGEST) == 0;
+    }
+
+    std::vector<uint8_t> verify_batch(const std::string &root, const std::vector<std::string> &keys,
+                                      const std::vector<std::string> &values, const std::vector<std::string> &proofs,
+                                      int threads) {
+        if (keys.size() != proofs.size() || values.size() != proofs.size())
+            throw std::invalid_argument("verify_batch: keys, values and proofs differ in length");
+        std::vector<uint8_t> ok(proofs.size(), 0);
+        // neighbouring keys share most of their paths, so they go to one thread
+        std::vector<size_t> order(proofs.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            if (keys[a].length() != keys[b].length())
+                return keys[a].length() < keys[b].length();
+            return keys[a] < keys[b];
+        });
+        if (threads <= 0)
+            threads = (int)std::thread::hardware_concurrency();
+        size_t n = std::min<size_t>(threads < 1 ? 1 : threads, (proofs.size() + BATCH_CHUNK - 1) / BATCH_CHUNK);
+        if (n <= 1) {
+            verify_range(root, keys, values, proofs, order, 0, proofs.size(), ok);
+            return ok;
+        }
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < n; ++t) {
+            size_t first = proofs.size() * t / n, last = proofs.size() * (t + 1) / n;
+            workers.emplace_back([&, first, last] {
+                verify_range(root, keys, values, proofs, order, first, last, ok);
+            });
+        }
+        for (auto &w : workers)
+            w.join();
+        return ok;
+    }
+}
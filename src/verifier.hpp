@@ -0,0 +1,46 @@
+#ifndef DUPTREE_VERIFIER_HPP
+#define DUPTREE_VERIFIER_HPP
+
+#include <string>
+#include <cstdint>
+#include <vector>
+
+// Proof checking without a tree object or IO: the root digest, the key, the
+// value and a binary proof are all it takes, and verify() does not allocate.
+// Digests in a binary proof are 32 raw bytes; empty children are left out and
+// flagged in a bitmap instead of being sent as null64.
+//
+//   [family u8][flags u8][steps varint], then per step
+//   MERKLE [sibling 32]                                   leaf to root
+//   SPARSE [bits u8: 1 right child, 2 sibling present][sibling 32]?   root to leaf
+//   HEX    [which u8][present u16 LE, bit j for child j][32 per present child]   root to leaf
+//
+// MERKLE sides come from the itos() position in the key. Flag ABSENT stands
+// for the "?" proof of a key that is not in the tree. It holds no path to the
+// root, so verify() rejects it: absence cannot be checked without the tree.
+namespace verifier {
+    enum Family : uint8_t {
+        MERKLE = 0, // Merkle / DupTree family, the value is the leaf digest
+        SPARSE = 1, // binary sparse trees, the leaf is SHA-256(value)
+        HEX = 2, // 16-ary fat and rat trees, the leaf is SHA-256(value)
+    };
+
+    const uint8_t ABSENT = 1;
+    const int MAX_STEPS = 256;
+    const size_t BATCH_CHUNK = 256; // verify_batch: fewest proofs worth a thread
+
+    // Converts a MemChecker::gen_proof proof; throws std::invalid_argument if
+    // it is not one of family.
+    std::string encode_proof(Family family, const std::string &proof);
+    // root is the hex digest of MemChecker::get_digest(); a malformed proof is false.
+    bool verify(const std::string &root, const std::string &key, const std::string &value, const std::string &proof);
+    // verify() of every (keys[i], values[i], proofs[i]) against one root,
+    // result i is 1 if proof i holds. Proofs climb level by level so that
+    // shared upper paths are hashed once, and large batches are split across
+    // threads (0 means hardware threads).
+    std::vector<uint8_t> verify_batch(const std::string &root, const std::vector<std::string> &keys,
+                                      const std::vector<std::string> &values, const std::vector<std::string> &proofs,
+                                      int threads = 0);
+}
+
+#endif //DUPTREE_VERIFIER_HPP
@@ -0,0 +1,127 @@
+#include "workload.hpp"
+#include <cmath>
+#include <stdexcept>
+
+double ZipfSampler::helper1(double x) {
+    // log1p(x) / x, accurate near 0
+    return std::fabs(x) > 1e-8 ? std::log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+}
+
+double ZipfSampler::helper2(double x) {
+    // expm1(x) / x, accurate near 0
+    return std::fabs(x) > 1e-8 ? std::expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x * (1.0 / 3.0) * (1.0 + 0.25 * x));
+}
+
+double ZipfSampler::h(double x) const {
+    return std::exp(-s * std::log(x));
+}
+
+double ZipfSampler::h_integral(double x) const {
+    double log_x = std::log(x);
+    return helper2((1.0 - s) * log_x) * log_x;
+}
+
+double ZipfSampler::h_integral_inverse(double x) const {
+    double t = x * (1.0 - s);
+    if (t < -1.0)
+        t = -1.0;
+    return std::exp(helper1(t) * x);
+}
+
+ZipfSampler::ZipfSampler(Int n, double s) : n(n), s(s) {
+    if (n < 1 || s <= 0)
+        throw std::invalid_argument("invalid zipf parameters");
+    h_integral_x1 = h_integral(1.5) - 1.0;
+    h_integral_n = h_integral((double)n + 0.5);
+    s_coef = 2.0 - h_integral_inverse(h_integral(2.5) - h(2.0));
+}
+
+Int ZipfSampler::sample(std::mt19937_64 &rng) const {
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    for ( ; ; ) {
+        double u = h_integral_n + uniform(rng) * (h_integral_x1 - h_integral_n);
+        double x = h_integral_inverse(u);
+        auto k = (Int)(x + 0.5);
+        if (k < 1)
+            k = 1;
+        else if (k > n)
+            k = n;
+        if ((double)k - x <= s_coef || u >= h_integral((double)k + 0.5) - h((double)k))
+            return k;
+    }
+}
+
+Workload::Workload(const WorkloadConfig &config, bool hex_keys)
+        : config(config), hex_keys(hex_keys), rng(config.seed), zipf(config.key_space, config.zipf_s) {
+    if (config.key_space < 1 || config.ops_per_block < 0)
+        throw std::invalid_argument("invalid workload size");
+    if (config.distribution != "uniform" && config.distribution != "zipf" &&
+        config.distribution != "sequential" && config.distribution != "hotset")
+        throw std::invalid_argument("unknown distribution: " + config.distribution);
+}
+
+// FNV-1a over the rank, as YCSB does, so that hot ranks are not neighbours.
+Int Workload::scramble(Int rank) const {
+    if (!config.scramble)
+        return rank;
+    uint64_t h = 14695981039346656037ULL;
+    for (int i = 0; i < 8; ++i) {
+        h ^= (uint64_t)(rank >> (i * 8)) & 0xff;
+        h *= 1099511628211ULL;
+    }
+    return (Int)(h % (uint64_t)config.key_space);
+}
+
+Int Workload::next_position() {
+    if (config.distribution == "zipf") {
+        return scramble(zipf.sample(rng) - 1);
+    }
+    if (config.distribution == "sequential") {
+        Int pos = cursor;
+        cursor = (cursor + 1) % config.key_space;
+        return pos;
+    }
+    std::uniform_int_distribution<Int> uniform(0, config.key_space - 1);
+    if (config.distribution == "hotset") {
+        std::uniform_real_distribution<double> coin(0.0, 1.0);
+        if (coin(rng) < config.hot_fraction) {
+            Int size = config.hot_size < config.key_space ? config.hot_size : config.key_space;
+            std::uniform_int_distribution<Int> hot(0, size - 1);
+            // the window stays contiguous, and with hex keys in one subtree
+            return (hot_start + hot(rng)) % config.key_space;
+        }
+    }
+    return uniform(rng);
+}
+
+std::string Workload::key_of(Int pos, bool hex_keys) {
+    if (!hex_keys)
+        return itos(pos);
+    std::string key(40, '0');
+    for (Int i = 39; i >= 0 && pos > 0; --i, pos >>= 4)
+        key[i] = "0123456789ABCDEF"[pos & 15];
+    return key;
+}
+
+bool Workload::next(TraceBlock &block) {
+    if (number >= config.blocks)
+        return false;
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    block.number = number;
+    block.committed = true;
+    block.ops.resize(config.ops_per_block);
+    std::string suffix = "@" + std::to_string(number);
+    for (auto &op : block.ops) {
+        op.type = coin(rng) < config.read_ratio ? 'r' : 'w';
+        op.key = key_of(next_position(), hex_keys);
+        if (op.type == 'w') {
+            // Merkle/DupTree leaves are 64-character digests
+            op.value = hex_keys ? op.key + suffix : calculateSHA256Hash(op.key + suffix);
+        } else {
+            op.value.clear();
+        }
+    }
+    ++number;
+    hot_start = (hot_start + config.hot_shift) % config.key_space;
+    return true;
+}
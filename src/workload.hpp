@@ -0,0 +1,65 @@
+#ifndef DUPTREE_WORKLOAD_HPP
+#define DUPTREE_WORKLOAD_HPP
+
+#include <string>
+#include <random>
+#include <cstdint>
+#include "tools.hpp"
+#include "replay.hpp"
+
+// Zipf(s) ranks in [1, n] by rejection-inversion (Hörmann and Derflinger), so
+// setup is O(1) and key spaces of 2^40 need no precomputed zeta table.
+class ZipfSampler {
+    Int n;
+    double s, h_integral_x1, h_integral_n, s_coef;
+
+    static double helper1(double x);
+    static double helper2(double x);
+    double h(double x) const;
+    double h_integral(double x) const;
+    double h_integral_inverse(double x) const;
+
+public:
+    ZipfSampler(Int n, double s);
+    Int sample(std::mt19937_64 &rng) const;
+};
+
+struct WorkloadConfig {
+    std::string distribution = "uniform"; // uniform | zipf | sequential | hotset
+    Int key_space = 1LL << 20; // positions are drawn from [0, key_space)
+    double zipf_s = 0.99; // zipf exponent, larger is more skewed
+    double read_ratio = 0.5; // fraction of ops that are gen_proof
+    Int hot_size = 1000; // hotset: positions in the hot window
+    double hot_fraction = 0.9; // hotset: fraction of ops inside the window
+    Int hot_shift = 100; // hotset: window slides by this many positions per block
+    bool scramble = true; // zipf: spread popular ranks over the key space
+    Int ops_per_block = 100;
+    Int blocks = 10000;
+    uint64_t seed = 1;
+};
+
+// Generates blocks of ops in the same shape as a replayed trace. Keys are
+// 40 upper-case hex characters for prefix trees (hex_keys) or itos()
+// positions for the Merkle/DupTree family. Write values are key + "@" + block,
+// hashed for the Merkle/DupTree family whose leaves must be 64 characters.
+class Workload {
+    WorkloadConfig config;
+    bool hex_keys;
+    std::mt19937_64 rng;
+    ZipfSampler zipf;
+    Int number = 0, cursor = 0, hot_start = 0;
+
+    Int next_position();
+    Int scramble(Int rank) const;
+
+public:
+    Workload(const WorkloadConfig &config, bool hex_keys);
+
+    // Hex keys put the high nibbles of pos first, so that neighbouring
+    // positions share a prefix and a path down the trie.
+    static std::string key_of(Int pos, bool hex_keys);
+    // False once config.blocks blocks have been produced.
+    bool next(TraceBlock &block);
+};
+
+#endif //DUPTREE_WORKLOAD_HPP